@@ -107,19 +107,55 @@ bool _UpdateUIStyleColor(RimeConfig* config,
                          std::string color = "");
 void _LoadAppOptions(RimeConfig* config, AppOptionsByAppName& app_options);
 
-void _RefreshTrayIcon(const RimeSessionId session_id,
-                      const std::function<void()> _UpdateUICallback) {
-  // Dangerous, don't touch
-  static char app_name[50];
-  RimeGetProperty(session_id, "client_app", app_name, sizeof(app_name) - 1);
-  if (string_to_wstring(app_name, CP_UTF8) == std::wstring(L"explorer.exe"))
-    boost::thread th([=]() {
-      ::Sleep(100);
-      if (_UpdateUICallback)
-        _UpdateUICallback();
-    });
-  else if (_UpdateUICallback)
-    _UpdateUICallback();
+// ascii mode with nothing composing, the application gets most keys
+static bool _IsKeyFilterActive(const RimeStatus& status) {
+  return status.is_ascii_mode && !status.is_composing && !status.is_disabled;
+}
+
+// keys ascii_composer rejects in ascii mode, provided that it sees them first.
+// function keys are left out for switcher hotkeys like F4
+static void _LoadKeyFilter(KeyFilter& filter, RimeConfig* config) {
+  filter.clear();
+  char processor[64] = {0};
+  if (!RimeConfigGetString(config, "engine/processors/@0", processor,
+                           sizeof(processor) - 1) ||
+      std::string(processor) != "ascii_composer")
+    return;
+  auto set = [&filter](unsigned int first, unsigned int last) {
+    for (unsigned int keycode = first; keycode <= last; ++keycode)
+      filter.keys.set(KeyFilter::index(keycode));
+  };
+  set(0x20, 0x7e);      // printable
+  set(0xff08, 0xff0d);  // BackSpace .. Return
+  set(0xff1b, 0xff1b);  // Escape
+  set(0xff50, 0xff58);  // cursor keys
+  set(0xff63, 0xff63);  // Insert
+  set(0xff80, 0xffb9);  // keypad
+  set(0xffff, 0xffff);  // Delete
+  // the filter is never learned at runtime, a skipped key does not reach
+  // the server; keys bound without modifiers are sent anyway. This is
+  // defensive only: with ascii_composer at @0 such a binding cannot fire
+  // in ascii mode while not composing, which is when the filter applies
+  RimeConfigIterator iter;
+  if (!RimeConfigBeginList(&iter, config, "key_binder/bindings"))
+    return;
+  while (RimeConfigNext(&iter)) {
+    char accept[64] = {0};
+    std::string path = std::string(iter.path) + "/accept";
+    if (!RimeConfigGetString(config, path.c_str(), accept, sizeof(accept) - 1))
+      continue;
+    std::string name(accept);
+    // modified keys are never filtered
+    if (name.empty() || (name.size() > 1 && name.find('+') != name.npos))
+      continue;
+    int keycode = name.size() == 1
+                      ? (unsigned char)name[0]
+                      : rime_get_api()->get_keycode_by_name(accept);
+    int i = KeyFilter::index(keycode);
+    if (i >= 0 && filter.keys.test(i))
+      filter.except(keycode);
+  }
+  RimeConfigEnd(&iter);
 }
 
 void RimeWithWeaselHandler::_Setup() {
@@ -204,6 +240,21 @@ DWORD RimeWithWeaselHandler::FindSession(WeaselSessionId ipc_id) {
   return found ? (ipc_id) : 0;
 }
 
+DWORD RimeWithWeaselHandler::KeyFilterGeneration(WeaselSessionId ipc_id) {
+  auto it = m_session_status_map.find(ipc_id);
+  if (m_disabled || it == m_session_status_map.end())
+    return 0;
+  return it->second.key_filter.generation;
+}
+
+// the client of ipc_id may hold a filter for a mode it is no longer in
+void RimeWithWeaselHandler::_InvalidateKeyFilter(WeaselSessionId ipc_id) {
+  auto it = m_session_status_map.find(ipc_id);
+  if (it != m_session_status_map.end() &&
+      ++it->second.key_filter.generation == 0)
+    it->second.key_filter.generation = 1;
+}
+
 DWORD RimeWithWeaselHandler::AddSession(LPWSTR buffer, EatLine eat) {
   if (m_disabled) {
     DLOG(INFO) << "Trying to resume service.";
@@ -238,7 +289,6 @@ DWORD RimeWithWeaselHandler::AddSession(LPWSTR buffer, EatLine eat) {
     _LoadSchemaSpecificSettings(ipc_id, schema_id);
     _LoadAppInlinePreeditSet(ipc_id, true);
     _UpdateInlinePreeditStatus(ipc_id);
-    _RefreshTrayIcon(session_id, _UpdateUICallback);
     session_status.status = status;
     session_status.__synced = false;
     RimeFreeStatus(&status);
@@ -257,7 +307,7 @@ DWORD RimeWithWeaselHandler::AddSession(LPWSTR buffer, EatLine eat) {
 
 DWORD RimeWithWeaselHandler::RemoveSession(WeaselSessionId ipc_id) {
   if (m_ui)
-    m_ui->Hide();
+    m_ui->PostHide();
   if (m_disabled)
     return 0;
   DLOG(INFO) << "Remove session: session_id = " << to_session_id(ipc_id);
@@ -318,7 +368,8 @@ BOOL RimeWithWeaselHandler::ProcessKeyEvent(KeyEvent keyEvent,
              << ", mask = " << keyEvent.mask << ", ipc_id = " << ipc_id;
   if (m_disabled)
     return FALSE;
-  RimeSessionId session_id = to_session_id(ipc_id);
+  SessionStatus& session_status = get_session_status(ipc_id);
+  RimeSessionId session_id = session_status.session_id;
   Bool handled = RimeProcessKey(session_id, keyEvent.keycode,
                                 expand_ibus_modifier(keyEvent.mask));
   if (!handled) {
@@ -410,7 +461,7 @@ void RimeWithWeaselHandler::FocusIn(DWORD client_caps, WeaselSessionId ipc_id) {
 void RimeWithWeaselHandler::FocusOut(DWORD param, WeaselSessionId ipc_id) {
   DLOG(INFO) << "Focus out: ipc_id = " << ipc_id;
   if (m_ui)
-    m_ui->Hide();
+    m_ui->PostHide();
   m_active_session = 0;
 }
 
@@ -420,7 +471,7 @@ void RimeWithWeaselHandler::UpdateInputPosition(RECT const& rc,
              << "), ipc_id = " << ipc_id
              << ", m_active_session = " << m_active_session;
   if (m_ui)
-    m_ui->UpdateInputPosition(rc);
+    m_ui->PostInputPosition(rc);
   if (m_disabled)
     return;
   if (m_active_session != ipc_id) {
@@ -494,8 +545,7 @@ void RimeWithWeaselHandler::_ReadClientInfo(WeaselSessionId ipc_id,
 
     auto it = m_app_options.find(app_name);
     if (it != m_app_options.end()) {
-      AppOptions& options(m_app_options[it->first]);
-      for (const auto& pair : options) {
+      for (const auto& pair : it->second.options) {
         DLOG(INFO) << "set app option: " << pair.first << " = " << pair.second;
         RimeSetOption(session_id, pair.first.c_str(), Bool(pair.second));
       }
@@ -538,6 +588,147 @@ void RimeWithWeaselHandler::_GetCandidateInfo(CandidateInfo& cinfo,
   cinfo.is_last_page = ctx.menu.is_last_page;
 }
 
+static std::string _GetCandidateLabel(RimeContext& ctx, int i) {
+  if (RIME_STRUCT_HAS_MEMBER(ctx, ctx.select_labels) && ctx.select_labels)
+    return ctx.select_labels[i];
+  if (ctx.menu.select_keys)
+    return std::string(1, ctx.menu.select_keys[i]);
+  return std::to_string((i + 1) % 10);
+}
+
+static bool _MatchCandidatePage(const CandidatePage& page, RimeContext& ctx) {
+  if (page.page_no != ctx.menu.page_no ||
+      page.highlighted != ctx.menu.highlighted_candidate_index ||
+      page.is_last_page != !!ctx.menu.is_last_page ||
+      page.texts.size() != (size_t)ctx.menu.num_candidates)
+    return false;
+  for (int i = 0; i < ctx.menu.num_candidates; ++i) {
+    const RimeCandidate& cand = ctx.menu.candidates[i];
+    if (page.texts[i] != cand.text ||
+        page.comments[i] != (cand.comment ? cand.comment : "") ||
+        page.labels[i] != _GetCandidateLabel(ctx, i))
+      return false;
+  }
+  return true;
+}
+
+static void _SerializeCandidatePage(CandidatePage& page) {
+  CandidateInfo cinfo;
+  size_t count = page.texts.size();
+  cinfo.candies.resize(count);
+  cinfo.comments.resize(count);
+  cinfo.labels.resize(count);
+  for (size_t i = 0; i < count; ++i) {
+    cinfo.candies[i].str =
+        escape_string(string_to_wstring(page.texts[i], CP_UTF8));
+    cinfo.comments[i].str =
+        escape_string(string_to_wstring(page.comments[i], CP_UTF8));
+    cinfo.labels[i].str =
+        escape_string(string_to_wstring(page.labels[i], CP_UTF8));
+  }
+  cinfo.highlighted = page.highlighted;
+  cinfo.currentPage = page.page_no;
+  cinfo.is_last_page = page.is_last_page;
+
+  std::wstringstream ss;
+  boost::archive::text_woarchive oa(ss);
+  oa << cinfo;
+  page.payload = std::string("ctx.cand=") +
+                 wstring_to_string(ss.str().c_str(), CP_UTF8) + '\n';
+}
+
+// serialized ctx.cand line of the current page, from cache if possible
+static const std::string& _GetCandidatePayload(SessionStatus& session_status,
+                                               RimeContext& ctx) {
+  const CandidatePage* cached = session_status.pages.Find(
+      [&ctx](const CandidatePage& page) {
+        return _MatchCandidatePage(page, ctx);
+      });
+  if (cached)
+    return cached->payload;
+  CandidatePage page;
+  page.page_no = ctx.menu.page_no;
+  page.highlighted = ctx.menu.highlighted_candidate_index;
+  page.is_last_page = !!ctx.menu.is_last_page;
+  for (int i = 0; i < ctx.menu.num_candidates; ++i) {
+    const RimeCandidate& cand = ctx.menu.candidates[i];
+    page.texts.push_back(cand.text);
+    page.comments.push_back(cand.comment ? cand.comment : "");
+    page.labels.push_back(_GetCandidateLabel(ctx, i));
+  }
+  _SerializeCandidatePage(page);
+  return session_status.pages.Add(std::move(page)).payload;
+}
+
+static void _PrefetchCandidatePage(SessionStatus& session_status,
+                                   RimeContext& ctx,
+                                   int page_no) {
+  RimeApi* api = rime_get_api();
+  int page_size = ctx.menu.page_size;
+  int start = page_no * page_size;
+  CandidatePage page;
+  page.page_no = page_no;
+  page.is_last_page = true;
+  // fetching the candidates also has librime generate them ahead of time
+  RimeCandidateListIterator iter = {0};
+  if (!api->candidate_list_from_index(session_status.session_id, &iter,
+                                      start))
+    return;
+  while (api->candidate_list_next(&iter)) {
+    if (iter.index >= start + page_size) {
+      page.is_last_page = false;
+      break;
+    }
+    page.texts.push_back(iter.candidate.text);
+    page.comments.push_back(iter.candidate.comment ? iter.candidate.comment
+                                                   : "");
+  }
+  api->candidate_list_end(&iter);
+  if (page.texts.empty())
+    return;
+  int count = (int)page.texts.size();
+  for (int i = 0; i < count; ++i)
+    page.labels.push_back(_GetCandidateLabel(ctx, i));
+  // librime keeps the highlighted position when flipping pages; should it
+  // not, the prefetched page just won't match
+  page.highlighted =
+      (std::min)(ctx.menu.highlighted_candidate_index, count - 1);
+  if (session_status.pages.Contains(page))
+    return;
+  _SerializeCandidatePage(page);
+  session_status.pages.Add(std::move(page));
+}
+
+bool RimeWithWeaselHandler::NeedsPrefetch(WeaselSessionId ipc_id) {
+  auto it = m_session_status_map.find(ipc_id);
+  return !m_disabled && it != m_session_status_map.end() &&
+         it->second.prefetch;
+}
+
+void RimeWithWeaselHandler::Prefetch(WeaselSessionId ipc_id,
+                                     std::function<bool()> const& preempted) {
+  if (m_disabled || preempted())
+    return;
+  auto it = m_session_status_map.find(ipc_id);
+  if (it == m_session_status_map.end())
+    return;
+  RimeApi* api = rime_get_api();
+  if (!api || !RIME_API_AVAILABLE(api, candidate_list_from_index))
+    return;
+  SessionStatus& session_status = it->second;
+  RIME_STRUCT(RimeContext, ctx);
+  if (RimeGetContext(session_status.session_id, &ctx)) {
+    if (ctx.menu.num_candidates && ctx.menu.page_size > 0) {
+      if (!ctx.menu.is_last_page)
+        _PrefetchCandidatePage(session_status, ctx, ctx.menu.page_no + 1);
+      // a request waiting for the lock goes first
+      if (ctx.menu.page_no > 0 && !preempted())
+        _PrefetchCandidatePage(session_status, ctx, ctx.menu.page_no - 1);
+    }
+    RimeFreeContext(&ctx);
+  }
+}
+
 void RimeWithWeaselHandler::StartMaintenance() {
   m_session_status_map.clear();
   Finalize();
@@ -546,6 +737,8 @@ void RimeWithWeaselHandler::StartMaintenance() {
 
 void RimeWithWeaselHandler::EndMaintenance() {
   if (m_disabled) {
+    // deployed, schema icons may have been replaced on disk
+    weasel::IconCache::Reset();
     Initialize();
     _UpdateUI(0);
   }
@@ -558,17 +751,22 @@ void RimeWithWeaselHandler::SetOption(WeaselSessionId ipc_id,
   // from no-session client, not actual typing session
   if (!ipc_id) {
     if (m_global_ascii_mode && opt == "ascii_mode") {
-      for (auto& pair : m_session_status_map)
+      for (auto& pair : m_session_status_map) {
         RimeSetOption(to_session_id(pair.first), "ascii_mode", val);
+        _InvalidateKeyFilter(pair.first);
+      }
     } else {
       RimeSetOption(to_session_id(m_active_session), opt.c_str(), val);
+      _InvalidateKeyFilter(m_active_session);
     }
   } else {
     RimeSetOption(to_session_id(ipc_id), opt.c_str(), val);
+    _InvalidateKeyFilter(ipc_id);
   }
 }
 
-void RimeWithWeaselHandler::OnUpdateUI(std::function<void()> const& cb) {
+void RimeWithWeaselHandler::OnUpdateUI(
+    std::function<void(weasel::Status const&)> const& cb) {
   _UpdateUICallback = cb;
 }
 
@@ -586,7 +784,8 @@ void RimeWithWeaselHandler::_UpdateUI(WeaselSessionId ipc_id) {
   if (!m_ui)
     return;
 
-  Status& weasel_status = m_ui->status();
+  // gather everything from rime here, the ui thread does the rest later
+  Status& weasel_status = m_status;
   Context weasel_context;
 
   RimeSessionId session_id = to_session_id(ipc_id);
@@ -595,7 +794,8 @@ void RimeWithWeaselHandler::_UpdateUI(WeaselSessionId ipc_id) {
   if (ipc_id == 0)
     weasel_status.disabled = m_disabled;
 
-  _GetStatus(weasel_status, ipc_id, weasel_context);
+  bool show_schema = _GetStatus(weasel_status, ipc_id, weasel_context);
+  Context schema_context = weasel_context;
 
   if (!is_tsf) {
     _GetContext(weasel_context, session_id);
@@ -607,15 +807,33 @@ void RimeWithWeaselHandler::_UpdateUI(WeaselSessionId ipc_id) {
   else
     session_status.style.client_caps &= ~INLINE_PREEDIT_CAPABLE;
 
-  if (weasel_status.composing && !is_tsf) {
-    m_ui->Update(weasel_context, weasel_status);
-    m_ui->Show();
-  } else if (!_ShowMessage(weasel_context, weasel_status) && !is_tsf) {
-    m_ui->Hide();
-    m_ui->Update(weasel_context, weasel_status);
-  }
-
-  _RefreshTrayIcon(session_id, _UpdateUICallback);
+  bool composing = weasel_status.composing && !is_tsf;
+  bool show_message = !composing && _ShowMessage(weasel_context, weasel_status);
+  int timeout = m_show_notifications_time;
+  weasel::UI* ui = m_ui;
+  auto callback = _UpdateUICallback;
+  Status status = weasel_status;
+  m_ui->PostUpdate([=]() {
+    if (show_schema) {
+      ui->Update(schema_context, status);
+      ui->ShowWithTimeout(timeout);
+    }
+    if (composing) {
+      ui->Update(weasel_context, status);
+      ui->Show();
+    } else if (show_message) {
+      ui->Update(weasel_context, status);
+      if (timeout)
+        ui->ShowWithTimeout(timeout);
+    } else if (!ui->IsCountingDown() && !is_tsf) {
+      ui->Hide();
+      ui->Update(weasel_context, status);
+    }
+    // the tray merges these and refreshes later on its own thread, with a
+    // copy of the status since ui->status() belongs to the panel
+    if (callback)
+      callback(status);
+  });
 
   m_message_type.clear();
   m_message_value.clear();
@@ -657,6 +875,7 @@ void RimeWithWeaselHandler::_LoadSchemaSpecificSettings(
   if (!RimeSchemaOpen(schema_id.c_str(), &config))
     return;
   _UpdateShowNotifications(&config);
+  _LoadKeyFilter(get_session_status(ipc_id).key_filter, &config);
   m_ui->style() = m_base_style;
   _UpdateUIStyle(&config, m_ui, false);
   SessionStatus& session_status = get_session_status(ipc_id);
@@ -725,16 +944,11 @@ void RimeWithWeaselHandler::_LoadAppInlinePreeditSet(WeaselSessionId ipc_id,
   bool found = false;
   if (!app_name.empty()) {
     auto it = m_app_options.find(app_name);
-    if (it != m_app_options.end()) {
-      AppOptions& options(m_app_options[it->first]);
-      for (const auto& pair : options) {
-        if (pair.first == "inline_preedit") {
-          RimeSetOption(session_id, pair.first.c_str(), Bool(pair.second));
-          session_status.style.inline_preedit = Bool(pair.second);
-          found = true;
-          break;
-        }
-      }
+    if (it != m_app_options.end() && it->second.has_inline_preedit) {
+      bool value = it->second.inline_preedit;
+      RimeSetOption(session_id, "inline_preedit", Bool(value));
+      session_status.style.inline_preedit = value;
+      found = true;
     }
   }
   if (!found) {
@@ -758,6 +972,7 @@ void RimeWithWeaselHandler::_LoadAppInlinePreeditSet(WeaselSessionId ipc_id,
     _UpdateInlinePreeditStatus(ipc_id);
 }
 
+// fill in the notification, return true if it is to be shown
 bool RimeWithWeaselHandler::_ShowMessage(Context& ctx, Status& status) {
   // show as auxiliary string
   std::wstring& tips(ctx.aux.str);
@@ -800,19 +1015,12 @@ bool RimeWithWeaselHandler::_ShowMessage(Context& ctx, Status& status) {
       status.type = FULL_SHAPE;
   }
   if (tips.empty() && !show_icon)
-    return m_ui->IsCountingDown();
+    return false;
   auto foption = m_show_notifications.find(m_option_name);
   auto falways = m_show_notifications.find("always");
-  if ((!add_session && (foption != m_show_notifications.end() ||
-                        falways != m_show_notifications.end())) ||
-      m_message_type == "deploy") {
-    m_ui->Update(ctx, status);
-    if (m_show_notifications_time)
-      m_ui->ShowWithTimeout(m_show_notifications_time);
-    return true;
-  } else {
-    return m_ui->IsCountingDown();
-  }
+  return (!add_session && (foption != m_show_notifications.end() ||
+                           falways != m_show_notifications.end())) ||
+         m_message_type == "deploy";
 }
 inline std::string _GetLabelText(const std::vector<Text>& labels,
                                  int id,
@@ -852,20 +1060,32 @@ bool RimeWithWeaselHandler::_Respond(WeaselSessionId ipc_id, EatLine eat) {
                        std::to_string(status.is_full_shape) + '\n');
     messages.push_back(std::string("status.schema_id=") +
                        std::string(status.schema_id) + '\n');
+    // sent every time, an empty filter has the client send every key
+    std::string key_filter;
+    if (_IsKeyFilterActive(status))
+      key_filter = session_status.key_filter.format();
+    messages.push_back(std::string("status.key_filter=") + key_filter + '\n');
     if (m_global_ascii_mode &&
         (session_status.status.is_ascii_mode != status.is_ascii_mode)) {
       for (auto& pair : m_session_status_map) {
-        if (pair.first != ipc_id)
+        if (pair.first != ipc_id) {
           RimeSetOption(to_session_id(pair.first), "ascii_mode",
                         !!status.is_ascii_mode);
+          _InvalidateKeyFilter(pair.first);
+        }
       }
     }
     session_status.status = status;
     RimeFreeStatus(&status);
   }
 
+  session_status.prefetch = false;
   RIME_STRUCT(RimeContext, ctx);
   if (RimeGetContext(session_id, &ctx)) {
+    // a full page or one past the first, there is another to flip to
+    session_status.prefetch =
+        ctx.menu.num_candidates &&
+        (!ctx.menu.is_last_page || ctx.menu.page_no > 0);
     if (is_composing) {
       actions.insert("ctx");
       switch (session_status.style.preedit_type) {
@@ -948,15 +1168,7 @@ bool RimeWithWeaselHandler::_Respond(WeaselSessionId ipc_id, EatLine eat) {
       }
     }
     if (ctx.menu.num_candidates) {
-      CandidateInfo cinfo;
-      std::wstringstream ss;
-      boost::archive::text_woarchive oa(ss);
-      _GetCandidateInfo(cinfo, ctx);
-
-      oa << cinfo;
-
-      messages.push_back(std::string("ctx.cand=") +
-                         wstring_to_string(ss.str().c_str(), CP_UTF8) + '\n');
+      messages.push_back(_GetCandidatePayload(session_status, ctx));
     }
     RimeFreeContext(&ctx);
   }
@@ -1293,6 +1505,8 @@ static void _UpdateUIStyle(RimeConfig* config, UI* ui, bool initialize) {
                           NULL, _abs);
   _RimeGetIntWithFallback(config, "style/layout/max_height", &style.max_height,
                           NULL, _abs);
+  _RimeGetBool(config, "style/layout/balanced_wrap", initialize,
+               style.balanced_wrap, true, false);
   // layout (alternative to style/horizontal)
   const std::map<std::string, UIStyle::LayoutType> _layoutMap = {
       {std::string("vertical"), UIStyle::LAYOUT_VERTICAL},
@@ -1503,12 +1717,21 @@ static void _LoadAppOptions(RimeConfig* config,
   RimeConfigIterator option_iter;
   RimeConfigBeginMap(&app_iter, config, "app_options");
   while (RimeConfigNext(&app_iter)) {
-    AppOptions& options(app_options[app_iter.key]);
+    // normalize app name once here, instead of on every lookup
+    std::string app_name(app_iter.key);
+    std::transform(app_name.begin(), app_name.end(), app_name.begin(),
+                   [](unsigned char c) { return (char)std::tolower(c); });
+    AppOptions& options(app_options[app_name]);
     RimeConfigBeginMap(&option_iter, config, app_iter.path);
     while (RimeConfigNext(&option_iter)) {
       Bool value = False;
       if (RimeConfigGetBool(config, option_iter.path, &value)) {
-        options[option_iter.key] = !!value;
+        std::string key(option_iter.key);
+        if (key == "inline_preedit") {
+          options.has_inline_preedit = true;
+          options.inline_preedit = !!value;
+        }
+        options.options.emplace_back(key, !!value);
       }
     }
     RimeConfigEnd(&option_iter);
@@ -1516,9 +1739,10 @@ static void _LoadAppOptions(RimeConfig* config,
   RimeConfigEnd(&app_iter);
 }
 
-void RimeWithWeaselHandler::_GetStatus(Status& stat,
+bool RimeWithWeaselHandler::_GetStatus(Status& stat,
                                        WeaselSessionId ipc_id,
                                        Context& ctx) {
+  bool show_schema = false;
   SessionStatus& session_status = get_session_status(ipc_id);
   RimeSessionId session_id = session_status.session_id;
   RIME_STRUCT(RimeStatus, status);
@@ -1542,19 +1766,17 @@ void RimeWithWeaselHandler::_GetStatus(Status& stat,
         if (session_status.style.inline_preedit != inline_preedit)
           // in case of inline_preedit set in schema
           _UpdateInlinePreeditStatus(ipc_id);
-        // refresh icon after schema changed
-        _RefreshTrayIcon(session_id, _UpdateUICallback);
         m_ui->style() = session_status.style;
         if (m_show_notifications.find("schema") != m_show_notifications.end() &&
             m_show_notifications_time > 0) {
           ctx.aux.str = stat.schema_name;
-          m_ui->Update(ctx, stat);
-          m_ui->ShowWithTimeout(m_show_notifications_time);
+          show_schema = true;
         }
       }
     }
     RimeFreeStatus(&status);
   }
+  return show_schema;
 }
 
 void RimeWithWeaselHandler::_GetContext(Context& weasel_context,
@@ -239,6 +239,8 @@ LRESULT WeaselIME::OnIMEFocus(BOOL fFocus) {
   } else {
     m_client.FocusOut();
   }
+  // ascii mode may have been switched from another session meanwhile
+  m_key_filter.clear();
   ImmUnlockIMC(m_hIMC);
 
   return 0;
@@ -303,6 +305,7 @@ LRESULT WeaselIME::_OnIMENotify(LPINPUTCONTEXT lpIMC, WPARAM wp, LPARAM lp) {
         _SetCompositionWindow(lpIMC);
     } break;
     case IMN_SETOPENSTATUS: {
+      m_key_filter.clear();
       if (!ImmGetOpenStatus(m_hIMC))  // gvim command mode
       {
         m_client.ClearComposition();  // cancel unfinished input (eg. quitting
@@ -365,16 +368,23 @@ BOOL WeaselIME::ProcessKeyEvent(UINT vKey,
     return FALSE;
   }
 
-  if (!m_client.Echo()) {
-    m_client.Connect(NULL);
-    m_client.StartSession();
-  }
-
   weasel::KeyEvent ke;
   if (!ConvertKeyEvent(vKey, kinfo, lpbKeyState, ke)) {
     // unknown key event
     return FALSE;
   }
+  // the server may have switched the mode since it handed out the filter
+  if (!m_key_filter.empty() &&
+      m_client.KeyFilterGeneration() != m_key_filter.generation)
+    m_key_filter.clear();
+  // the server told us it would not handle this key, skip the round trip
+  if (m_key_filter.skip(ke.keycode, ke.mask))
+    return FALSE;
+
+  if (!m_client.Echo()) {
+    m_client.Connect(NULL);
+    m_client.StartSession();
+  }
 
   bool accepted = m_client.ProcessKeyEvent(ke);
 
@@ -383,6 +393,7 @@ BOOL WeaselIME::ProcessKeyEvent(UINT vKey,
   weasel::Status status;
   weasel::ResponseParser parser(&commit, NULL, &status);
   bool ok = m_client.GetResponseData(std::ref(parser));
+  m_key_filter = ok ? status.key_filter : weasel::KeyFilter();
 
   if (ok) {
     if (!commit.empty()) {
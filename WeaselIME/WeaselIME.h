@@ -66,4 +66,6 @@ class WeaselIME {
   bool m_composing;
   bool m_preferCandidatePos;
   weasel::Client m_client;
+  // keys the server would not handle, as of its last response
+  weasel::KeyFilter m_key_filter;
 };
@@ -124,4 +124,31 @@ void StatusUpdater::Store(Deserializer::KeyType const& k,
     m_pTarget->p_status->full_shape = bool_value;
     return;
   }
+
+  if (k[1] == L"key_filter") {
+    // as written by KeyFilter::format
+    KeyFilter& filter = m_pTarget->p_status->key_filter;
+    filter.clear();
+    size_t colon = value.find(L':');
+    if (colon == std::wstring::npos)
+      return;
+    filter.generation = wcstoul(value.substr(0, colon).c_str(), NULL, 16);
+    size_t sep = value.find(L';', colon);
+    std::wstring keys = value.substr(colon + 1, sep - colon - 1);
+    for (size_t i = 0; i < keys.size() && i * 4 < KeyFilter::SIZE; ++i) {
+      unsigned int nibble = wcstoul(keys.substr(i, 1).c_str(), NULL, 16);
+      for (int b = 0; b < 4; ++b)
+        if (nibble & (1 << b))
+          filter.keys.set(KeyFilter::SIZE - 4 * (i + 1) + b);
+    }
+    if (sep == std::wstring::npos)
+      return;
+    std::vector<std::wstring> exceptions;
+    split(exceptions, value.substr(sep + 1), L",");
+    for (const auto& e : exceptions) {
+      if (!e.empty())
+        filter.except(wcstoul(e.c_str(), NULL, 16));
+    }
+    return;
+  }
 }
@@ -99,18 +99,28 @@ void PipeChannelBase::_FinalizePipe(HANDLE& p) {
 }
 
 void PipeChannelBase::_Receive(HANDLE pipe, LPVOID msg, size_t rec_len) {
+  if (_ReceiveHead(pipe, msg, rec_len))
+    _ReceiveBody(pipe);
+  has_body = false;
+}
+
+bool PipeChannelBase::_ReceiveHead(HANDLE pipe, LPVOID msg, size_t rec_len) {
   DWORD lread;
   BOOL success = ::ReadFile(pipe, msg, rec_len, &lread, NULL);
   if (!success) {
     _ThrowIfNot(ERROR_MORE_DATA);
+    return true;
+  }
+  return false;
+}
 
-    memset(buffer.get(), 0, buff_size);
-    success = ::ReadFile(pipe, buffer.get(), buff_size, &lread, NULL);
-    if (!success) {
-      _ThrowLastError;
-    }
+void PipeChannelBase::_ReceiveBody(HANDLE pipe) {
+  DWORD lread;
+  memset(buffer.get(), 0, buff_size);
+  BOOL success = ::ReadFile(pipe, buffer.get(), buff_size, &lread, NULL);
+  if (!success) {
+    _ThrowLastError;
   }
-  has_body = false;
 }
 
 HANDLE PipeChannelBase::_ConnectServerPipe(std::wstring& pn) {
@@ -176,6 +176,12 @@ bool ClientImpl::Echo() {
   return (serverEcho == session_id);
 }
 
+UINT ClientImpl::KeyFilterGeneration() {
+  if (!_Active())
+    return 0;
+  return (UINT)_SendMessage(WEASEL_IPC_KEY_FILTER_GENERATION, 0, session_id);
+}
+
 bool ClientImpl::GetResponseData(ResponseHandler const& handler) {
   if (!handler) {
     return false;
@@ -293,6 +299,10 @@ bool Client::Echo() {
   return m_pImpl->Echo();
 }
 
+UINT Client::KeyFilterGeneration() {
+  return m_pImpl->KeyFilterGeneration();
+}
+
 bool Client::GetResponseData(ResponseHandler handler) {
   return m_pImpl->GetResponseData(handler);
 }
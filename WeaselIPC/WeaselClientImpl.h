@@ -17,6 +17,7 @@ class ClientImpl {
   void StartMaintenance();
   void EndMaintenance();
   bool Echo();
+  UINT KeyFilterGeneration();
   bool ProcessKeyEvent(KeyEvent const& keyEvent);
   bool CommitComposition();
   bool ClearComposition();
@@ -17,9 +17,23 @@ class PipeServer : public PipeChannel<DWORD, PipeMessage> {
   void Listen(ServerHandler const& handler);
   /* Get a server runner */
   ServerRunner GetServerRunner(ServerHandler const& handler);
+  // for calls into the request handler from outside the pipe threads
+  boost::mutex& DispatchMutex() { return dispatch_mutex; }
+  // a request has been received and waits to be dispatched
+  bool HasWaiting() const { return waiting > 0; }
 
  private:
   void _ProcessPipeThread(HANDLE pipe, ServerHandler const& handler);
+
+  // requests from all connections share the channel buffer and the request
+  // handler, they are dispatched one at a time. One lock for all sessions
+  // on purpose: the handler's session map, the active session and the UI
+  // are shared by every session, so a queue per session would still have
+  // to take a handler-wide lock around each call.
+  // The window thread takes it too; that cannot deadlock since nothing run
+  // under it waits for the window thread, the handler only posts to it.
+  boost::mutex dispatch_mutex;
+  std::atomic<int> waiting{0};
 };
 }  // namespace weasel
 
@@ -58,7 +72,9 @@ LRESULT ServerImpl::OnColorChange(UINT uMsg,
                                   BOOL& bHandled) {
   if (IsUserDarkMode() != m_darkMode) {
     m_darkMode = IsUserDarkMode();
-    m_pRequestHandler->UpdateColorTheme(m_darkMode);
+    boost::lock_guard<boost::mutex> lock(channel->DispatchMutex());
+    if (m_pRequestHandler)
+      m_pRequestHandler->UpdateColorTheme(m_darkMode);
   }
   return 0;
 }
@@ -100,6 +116,7 @@ LRESULT ServerImpl::OnEndSystemSession(UINT uMsg,
                                        LPARAM lParam,
                                        BOOL& bHandled) {
   if (m_pRequestHandler) {
+    boost::lock_guard<boost::mutex> lock(channel->DispatchMutex());
     m_pRequestHandler->Finalize();
     m_pRequestHandler = nullptr;
   }
@@ -113,11 +130,18 @@ LRESULT ServerImpl::OnCommand(UINT uMsg,
   UINT uID = LOWORD(wParam);
   switch (uID) {
     case ID_WEASELTRAY_ENABLE_ASCII:
-      m_pRequestHandler->SetOption(lParam, "ascii_mode", true);
-      return 0;
-    case ID_WEASELTRAY_DISABLE_ASCII:
-      m_pRequestHandler->SetOption(lParam, "ascii_mode", false);
+    case ID_WEASELTRAY_DISABLE_ASCII: {
+      // WEASEL_IPC_TRAY_COMMAND is dispatched locked already, WM_COMMAND
+      // from the tray menu comes in on the window thread
+      boost::unique_lock<boost::mutex> lock(channel->DispatchMutex(),
+                                            boost::defer_lock);
+      if (uMsg == WM_COMMAND)
+        lock.lock();
+      if (m_pRequestHandler)
+        m_pRequestHandler->SetOption(lParam, "ascii_mode",
+                                     uID == ID_WEASELTRAY_ENABLE_ASCII);
       return 0;
+    }
     default:;
   }
 
@@ -130,6 +154,21 @@ LRESULT ServerImpl::OnCommand(UINT uMsg,
   return 0;
 }
 
+LRESULT ServerImpl::OnPrefetch(UINT uMsg,
+                               WPARAM wParam,
+                               LPARAM lParam,
+                               BOOL& bHandled) {
+  m_prefetch_posted = false;
+  // requests go first; one being dispatched now posts again if it may
+  // need a prefetch
+  boost::unique_lock<boost::mutex> lock(channel->DispatchMutex(),
+                                        boost::try_to_lock);
+  if (lock.owns_lock() && m_pRequestHandler)
+    m_pRequestHandler->Prefetch(m_prefetch_session,
+                                [this] { return channel->HasWaiting(); });
+  return 0;
+}
+
 DWORD ServerImpl::OnCommand(WEASEL_IPC_COMMAND uMsg,
                             DWORD wParam,
                             DWORD lParam) {
@@ -179,6 +218,10 @@ int ServerImpl::Run() {
   _Module.AddMessageLoop(&theLoop);
   int nRet = theLoop.Run();
   _Module.RemoveMessageLoop();
+  // pipe threads outlive the loop, detach the handler before the caller
+  // finalizes it so that none of them is still inside
+  boost::lock_guard<boost::mutex> lock(channel->DispatchMutex());
+  m_pRequestHandler = nullptr;
   return nRet;
 }
 
@@ -188,6 +231,14 @@ DWORD ServerImpl::OnEcho(WEASEL_IPC_COMMAND uMsg, DWORD wParam, DWORD lParam) {
   return m_pRequestHandler->FindSession(lParam);
 }
 
+DWORD ServerImpl::OnKeyFilterGeneration(WEASEL_IPC_COMMAND uMsg,
+                                        DWORD wParam,
+                                        DWORD lParam) {
+  if (!m_pRequestHandler)
+    return 0;
+  return m_pRequestHandler->KeyFilterGeneration(lParam);
+}
+
 DWORD ServerImpl::OnStartSession(WEASEL_IPC_COMMAND uMsg,
                                  DWORD wParam,
                                  DWORD lParam) {
@@ -377,6 +428,7 @@ void ServerImpl::HandlePipeMessage(PipeMessage pipe_msg, _Resp resp) {
 
   MAP_PIPE_MSG_HANDLE(pipe_msg.Msg, pipe_msg.wParam, pipe_msg.lParam)
   PIPE_MSG_HANDLE(WEASEL_IPC_ECHO, OnEcho)
+  PIPE_MSG_HANDLE(WEASEL_IPC_KEY_FILTER_GENERATION, OnKeyFilterGeneration)
   PIPE_MSG_HANDLE(WEASEL_IPC_START_SESSION, OnStartSession)
   PIPE_MSG_HANDLE(WEASEL_IPC_END_SESSION, OnEndSession)
   PIPE_MSG_HANDLE(WEASEL_IPC_PROCESS_KEY_EVENT, OnKeyEvent)
@@ -397,6 +449,19 @@ void ServerImpl::HandlePipeMessage(PipeMessage pipe_msg, _Resp resp) {
   END_MAP_PIPE_MSG_HANDLE(result);
 
   resp(result);
+
+  // the client has got its reply, look ahead later on the window thread
+  // instead of holding up the next request; only after a page was flipped
+  // or a candidate picked, or for a key that left a full page up
+  if (m_pRequestHandler &&
+      (pipe_msg.Msg == WEASEL_IPC_CHANGE_PAGE ||
+       pipe_msg.Msg == WEASEL_IPC_HIGHLIGHT_CANDIDATE_ON_CURRENT_PAGE ||
+       pipe_msg.Msg == WEASEL_IPC_PROCESS_KEY_EVENT) &&
+      m_pRequestHandler->NeedsPrefetch(pipe_msg.lParam)) {
+    m_prefetch_session = pipe_msg.lParam;
+    if (!m_prefetch_posted.exchange(true) && !PostMessage(WM_WEASEL_PREFETCH))
+      m_prefetch_posted = false;
+  }
 }
 
 PipeServer::PipeServer(std::wstring&& pn_cmd, SECURITY_ATTRIBUTES* s)
@@ -426,7 +491,14 @@ void PipeServer::_ProcessPipeThread(HANDLE pipe, ServerHandler const& handler) {
   try {
     for (;;) {
       Res msg;
-      _Receive(pipe, &msg, sizeof(msg));
+      // wait for the next request without holding the lock
+      bool more = _ReceiveHead(pipe, &msg, sizeof(msg));
+      ++waiting;
+      boost::lock_guard<boost::mutex> lock(dispatch_mutex);
+      --waiting;
+      if (more)
+        _ReceiveBody(pipe);
+      has_body = false;
       handler(msg, [this, pipe](Msg resp) { _Send(pipe, resp); });
     }
   } catch (...) {
@@ -1,5 +1,6 @@
 #pragma once
 #include <WeaselIPC.h>
+#include <atomic>
 #include <map>
 #include <Winnt.h>   // for security attributes constants
 #include <aclapi.h>  // for ACL
@@ -8,6 +9,9 @@
 
 #include "SecurityAttribute.h"
 
+// posted to the server window to look ahead after a request
+#define WM_WEASEL_PREFETCH (WEASEL_IPC_LAST_COMMAND + 1)
+
 namespace weasel {
 class PipeServer;
 
@@ -28,6 +32,7 @@ class ServerImpl : public CWindowImpl<ServerImpl, CWindow, ServerWinTraits>
   MESSAGE_HANDLER(WM_DWMCOLORIZATIONCOLORCHANGED, OnColorChange)
   MESSAGE_HANDLER(WM_SETTINGCHANGE, OnColorChange)
   MESSAGE_HANDLER(WM_COMMAND, OnCommand)
+  MESSAGE_HANDLER(WM_WEASEL_PREFETCH, OnPrefetch)
   END_MSG_MAP()
 
   LRESULT OnColorChange(UINT uMsg,
@@ -46,8 +51,12 @@ class ServerImpl : public CWindowImpl<ServerImpl, CWindow, ServerWinTraits>
                              LPARAM lParam,
                              BOOL& bHandled);
   LRESULT OnCommand(UINT uMsg, WPARAM wParam, LPARAM lParam, BOOL& bHandled);
+  LRESULT OnPrefetch(UINT uMsg, WPARAM wParam, LPARAM lParam, BOOL& bHandled);
   DWORD OnCommand(WEASEL_IPC_COMMAND uMsg, DWORD wParam, DWORD lParam);
   DWORD OnEcho(WEASEL_IPC_COMMAND uMsg, DWORD wParam, DWORD lParam);
+  DWORD OnKeyFilterGeneration(WEASEL_IPC_COMMAND uMsg,
+                              DWORD wParam,
+                              DWORD lParam);
   DWORD OnStartSession(WEASEL_IPC_COMMAND uMsg, DWORD wParam, DWORD lParam);
   DWORD OnEndSession(WEASEL_IPC_COMMAND uMsg, DWORD wParam, DWORD lParam);
   DWORD OnKeyEvent(WEASEL_IPC_COMMAND uMsg, DWORD wParam, DWORD lParam);
@@ -98,6 +107,9 @@ class ServerImpl : public CWindowImpl<ServerImpl, CWindow, ServerWinTraits>
   HMODULE m_hUser32Module;
   SecurityAttribute sa;
   BOOL m_darkMode;
+  // the session to prefetch for, and whether WM_WEASEL_PREFETCH is queued
+  std::atomic<DWORD> m_prefetch_session{0};
+  std::atomic<bool> m_prefetch_posted{false};
 };
 
 }  // namespace weasel
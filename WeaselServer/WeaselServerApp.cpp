@@ -27,16 +27,19 @@ int WeaselServerApp::Run() {
   else
     win_sparkle_set_lang("en");
   win_sparkle_init();
-  m_ui.Create(m_server.GetHWnd());
+  m_ui.Create(m_server.GetHWnd(), true);
 
   m_handler->Initialize();
-  m_handler->OnUpdateUI([this]() { tray_icon.Refresh(); });
+  m_handler->OnUpdateUI([this](weasel::Status const& status) {
+    tray_icon.ScheduleRefresh(status, m_ui.panel_style());
+  });
 
   tray_icon.Create(m_server.GetHWnd());
   tray_icon.Refresh();
 
   int ret = m_server.Run();
 
+  // the server has let go of the handler, no request reaches it any more
   m_handler->Finalize();
   m_ui.Destroy();
   tray_icon.RemoveIcon();
@@ -47,6 +50,10 @@ int WeaselServerApp::Run() {
 
 void WeaselServerApp::SetupMenuHandlers() {
   std::filesystem::path dir = install_dir();
+  m_server.AddMenuHandler(ID_WEASELTRAY_REFRESH, [this] {
+    tray_icon.OnRefreshRequest();
+    return true;
+  });
   m_server.AddMenuHandler(ID_WEASELTRAY_QUIT,
                           [this] { return m_server.Stop() == 0; });
   m_server.AddMenuHandler(ID_WEASELTRAY_DEPLOY,
@@ -10,8 +10,7 @@ static const WCHAR* mode_label[] = {NULL, /*L"中文"*/ NULL, /*L"西文"*/ NULL
                                     L"Under maintenance"};
 
 WeaselTrayIcon::WeaselTrayIcon(weasel::UI& ui)
-    : m_style(ui.style()),
-      m_status(ui.status()),
+    : m_ui(ui),
       m_mode(INITIAL),
       m_schema_zhung_icon(),
       m_schema_ascii_icon(),
@@ -20,6 +19,14 @@ WeaselTrayIcon::WeaselTrayIcon(weasel::UI& ui)
 void WeaselTrayIcon::CustomizeMenu(HMENU hMenu) {}
 
 BOOL WeaselTrayIcon::Create(HWND hTargetWnd) {
+  // taken before the first update is posted
+  m_style = m_ui.style();
+  m_status = m_ui.status();
+  {
+    std::lock_guard<std::mutex> lock(m_next_mutex);
+    m_next_style = m_style;
+    m_next_status = m_status;
+  }
   HMODULE hModule = GetModuleHandle(NULL);
   CIcon icon;
   icon.LoadIconW(IDI_ZH);
@@ -37,6 +44,57 @@ BOOL WeaselTrayIcon::Create(HWND hTargetWnd) {
   return bRet;
 }
 
+UINT_PTR WeaselTrayIcon::timer = 0;
+
+void WeaselTrayIcon::ScheduleRefresh(const weasel::Status& status,
+                                     const weasel::UIStyle& style) {
+  {
+    std::lock_guard<std::mutex> lock(m_next_mutex);
+    m_next_status = status;
+    if (m_next_style != style)
+      m_next_style = style;
+  }
+  // already on the way, it will read the latest state
+  if (m_refresh_requested.exchange(true))
+    return;
+  if (!::PostMessage(GetTargetWnd(), WM_COMMAND, ID_WEASELTRAY_REFRESH, 0))
+    m_refresh_requested = false;
+}
+
+void WeaselTrayIcon::OnRefreshRequest() {
+  if (timer)
+    return;
+  timer = UINT_PTR(this);
+  if (!::SetTimer(GetSafeHwnd(), REFRESH_TIMER, REFRESH_INTERVAL,
+                  &WeaselTrayIcon::OnTimer)) {
+    timer = 0;
+    m_refresh_requested = false;
+    _TakeNext();
+    Refresh();
+  }
+}
+
+void WeaselTrayIcon::_TakeNext() {
+  std::lock_guard<std::mutex> lock(m_next_mutex);
+  m_status = m_next_status;
+  if (m_style != m_next_style)
+    m_style = m_next_style;
+}
+
+VOID CALLBACK WeaselTrayIcon::OnTimer(_In_ HWND hwnd,
+                                      _In_ UINT uMsg,
+                                      _In_ UINT_PTR idEvent,
+                                      _In_ DWORD dwTime) {
+  ::KillTimer(hwnd, idEvent);
+  WeaselTrayIcon* self = (WeaselTrayIcon*)timer;
+  timer = 0;
+  if (self) {
+    self->m_refresh_requested = false;
+    self->_TakeNext();
+    self->Refresh();
+  }
+}
+
 void WeaselTrayIcon::Refresh() {
   if (!m_style.display_tray_icon &&
       !m_status.disabled)  // display notification when deploying
@@ -66,18 +124,15 @@ void WeaselTrayIcon::Refresh() {
     m_mode = mode;
     m_schema_zhung_icon = m_style.current_zhung_icon;
     m_schema_ascii_icon = m_style.current_ascii_icon;
-    if (mode == ASCII) {
-      if (m_schema_ascii_icon.empty())
-        SetIcon(mode_icon[mode]);
-      else
-        SetIcon(m_schema_ascii_icon.c_str());
-    } else if (mode == ZHUNG) {
-      if (m_schema_zhung_icon.empty())
-        SetIcon(mode_icon[mode]);
-      else
-        SetIcon(m_schema_zhung_icon.c_str());
-    } else
-      SetIcon(mode_icon[mode]);
+    // icons are shared with the candidate panel, toggling does not load any
+    static const std::wstring builtin;
+    const std::wstring& path = mode == ASCII   ? m_schema_ascii_icon
+                               : mode == ZHUNG ? m_schema_zhung_icon
+                                               : builtin;
+    HICON icon = weasel::IconCache::Get(path, mode_icon[mode], 0, 0,
+                                        GetModuleHandle(NULL));
+    if (icon)
+      SetIcon(icon);
 
     if (mode_label[mode] && m_disabled == false) {
       CString info;
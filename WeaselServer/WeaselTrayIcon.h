@@ -2,8 +2,12 @@
 #include <WeaselUI.h>
 #include <WeaselIPC.h>
 #include "SystemTraySDK.h"
+#include <atomic>
+#include <mutex>
 
 #define WM_WEASEL_TRAY_NOTIFY (WEASEL_IPC_LAST_COMMAND + 100)
+// sent to the target window to refresh the tray on its own thread
+#define ID_WEASELTRAY_REFRESH (WEASEL_IPC_LAST_COMMAND + 101)
 
 class WeaselTrayIcon : public CSystemTray {
  public:
@@ -18,14 +22,37 @@ class WeaselTrayIcon : public CSystemTray {
 
   BOOL Create(HWND hTargetWnd);
   void Refresh();
+  // thread safe, requests arriving within REFRESH_INTERVAL are merged into
+  // one Refresh with the latest state
+  void ScheduleRefresh(const weasel::Status& status,
+                       const weasel::UIStyle& style);
+  // on the tray's thread, for ID_WEASELTRAY_REFRESH
+  void OnRefreshRequest();
+
+  static VOID CALLBACK OnTimer(_In_ HWND hwnd,
+                               _In_ UINT uMsg,
+                               _In_ UINT_PTR idEvent,
+                               _In_ DWORD dwTime);
+  static const int REFRESH_TIMER = 20240901;
+  static const UINT REFRESH_INTERVAL = 100;
+  static UINT_PTR timer;
 
  protected:
   virtual void CustomizeMenu(HMENU hMenu);
+  // copies the state scheduled last, on the tray's thread
+  void _TakeNext();
 
-  weasel::UIStyle& m_style;
-  weasel::Status& m_status;
+  weasel::UI& m_ui;
+  // the tray's own copies, the ui's are written on other threads
+  weasel::UIStyle m_style;
+  weasel::Status m_status;
   WeaselTrayMode m_mode;
   std::wstring m_schema_zhung_icon;
   std::wstring m_schema_ascii_icon;
   bool m_disabled;
+  std::atomic<bool> m_refresh_requested{false};
+  // the latest state handed over by ScheduleRefresh
+  std::mutex m_next_mutex;
+  weasel::UIStyle m_next_style;
+  weasel::Status m_next_status;
 };
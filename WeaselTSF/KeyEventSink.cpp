@@ -10,29 +10,41 @@ void WeaselTSF::_ProcessKeyEvent(WPARAM wParam, LPARAM lParam, BOOL* pfEaten) {
     return;
   }
 
-  // if server connection is Not OK, don't eat it.
-  if (!_EnsureServerConnected()) {
-    *pfEaten = FALSE;
-    return;
-  }
   weasel::KeyEvent ke;
   GetKeyboardState(_lpbKeyState);
   if (!ConvertKeyEvent(static_cast<UINT>(wParam), lParam, _lpbKeyState, ke)) {
     /* Unknown key event */
     *pfEaten = FALSE;
-  } else {
-    // cheet key code when vertical auto reverse happened, swap up and down
-    if (_cand->GetIsReposition()) {
-      if (ke.keycode == ibus::Up)
-        ke.keycode = ibus::Down;
-      else if (ke.keycode == ibus::Down)
-        ke.keycode = ibus::Up;
-    }
-    *pfEaten = (BOOL)m_client.ProcessKeyEvent(ke);
+    return;
+  }
+  // cheet key code when vertical auto reverse happened, swap up and down
+  if (_cand->GetIsReposition()) {
+    if (ke.keycode == ibus::Up)
+      ke.keycode = ibus::Down;
+    else if (ke.keycode == ibus::Down)
+      ke.keycode = ibus::Up;
+  }
+  // the server may have switched the mode since it handed out the filter
+  if (!_status.key_filter.empty() &&
+      m_client.KeyFilterGeneration() != _status.key_filter.generation)
+    _status.key_filter.clear();
+  // the server told us it would not handle this key, skip the round trip
+  if (_status.key_filter.skip(ke.keycode, ke.mask)) {
+    *pfEaten = FALSE;
+    return;
+  }
+
+  // if server connection is Not OK, don't eat it.
+  if (!_EnsureServerConnected()) {
+    *pfEaten = FALSE;
+    return;
   }
+  *pfEaten = (BOOL)m_client.ProcessKeyEvent(ke);
 }
 
 STDAPI WeaselTSF::OnSetFocus(BOOL fForeground) {
+  // ascii mode may have been switched from another session meanwhile
+  _status.key_filter.clear();
   if (fForeground)
     m_client.FocusIn();
   else {
@@ -299,6 +299,8 @@ std::wstring WeaselTSF::_GetRootDir() {
 }
 
 void WeaselTSF::_HandleLangBarMenuSelect(UINT wID) {
+  // any of these may change the mode without a key response
+  _status.key_filter.clear();
   std::wstring dir{};
   switch (wID) {
     case ID_WEASELTRAY_RERUN_SERVICE:
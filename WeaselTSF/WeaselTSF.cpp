@@ -220,6 +220,7 @@ STDMETHODIMP WeaselTSF::OnActivated(REFCLSID clsid,
 }
 
 void WeaselTSF::_Reconnect() {
+  _status.key_filter.clear();
   m_client.Disconnect();
   m_client.Connect(NULL);
   m_client.StartSession();
@@ -2,6 +2,8 @@
 #include <string>
 #include <algorithm>
 #include <map>
+#include <mutex>
+#include <tuple>
 #include <WeaselUI.h>
 
 using namespace weasel;
@@ -89,6 +91,36 @@ DirectWriteResources::~DirectWriteResources() {
   pD2d1Factory.Reset();
 }
 
+// text formats are immutable once set up, so they are shared by every
+// DirectWriteResources of the process, keyed by everything they are built from
+struct TextFormatKey {
+  std::wstring font_face;
+  int font_point;
+  float dpi_scale;
+  DWRITE_WORD_WRAPPING wrapping;
+  bool vertical_text;
+  DWRITE_FLOW_DIRECTION flow;
+  float line_spacing;
+  float baseline;
+  bool operator<(const TextFormatKey& key) const {
+    return std::tie(font_face, font_point, dpi_scale, wrapping, vertical_text,
+                    flow, line_spacing, baseline) <
+           std::tie(key.font_face, key.font_point, key.dpi_scale, key.wrapping,
+                    key.vertical_text, key.flow, key.line_spacing,
+                    key.baseline);
+  }
+};
+
+// a few styles at a few dpis, plus the sizes tried by full screen layouts
+static const size_t MAX_CACHED_TEXT_FORMATS = 64;
+
+static std::mutex _textFormatMutex;
+using TextFormatList =
+    std::list<std::pair<TextFormatKey, ComPtr<IDWriteTextFormat1>>>;
+static TextFormatList _textFormats;
+static std::map<TextFormatKey, TextFormatList::iterator> _textFormatIndex;
+static std::map<std::wstring, ComPtr<IDWriteFontFallback>> _fontFallbacks;
+
 HRESULT DirectWriteResources::InitResources(
     const std::wstring& label_font_face,
     const int& label_font_point,
@@ -102,6 +134,10 @@ HRESULT DirectWriteResources::InitResources(
   pTextFormat.Reset();
   pLabelTextFormat.Reset();
   pCommentTextFormat.Reset();
+  // sizes measured with the old formats are no longer valid
+  _textSizes.clear();
+  _textSizeIndex.clear();
+  _staticTextLayouts.clear();
   DWRITE_WORD_WRAPPING wrapping =
       ((_style.max_width == 0 &&
         _style.layout_type != UIStyle::LAYOUT_VERTICAL_TEXT) ||
@@ -116,138 +152,86 @@ HRESULT DirectWriteResources::InitResources(
         _style.layout_type == UIStyle::LAYOUT_VERTICAL_TEXT))
           ? DWRITE_WORD_WRAPPING_NO_WRAP
           : DWRITE_WORD_WRAPPING_CHARACTER;
-  DWRITE_FLOW_DIRECTION flow = _style.vertical_text_left_to_right
-                                   ? DWRITE_FLOW_DIRECTION_LEFT_TO_RIGHT
-                                   : DWRITE_FLOW_DIRECTION_RIGHT_TO_LEFT;
 
   HRESULT hResult = S_OK;
-  std::vector<std::wstring> fontFaceStrVector;
+  hResult = _GetTextFormat(font_face, font_point, wrapping, vertical_text,
+                           pTextFormat);
+  hResult = _GetTextFormat(font_face, font_point, wrapping_preedit,
+                           vertical_text, pPreeditTextFormat);
+  hResult = _GetTextFormat(label_font_face, label_font_point, wrapping,
+                           vertical_text, pLabelTextFormat);
+  hResult = _GetTextFormat(comment_font_face, comment_font_point, wrapping,
+                           vertical_text, pCommentTextFormat);
+  return hResult;
+}
 
-  // text font text format set up
-  fontFaceStrVector = ws_split(font_face, L",");
-  // set main font a invalid font name, to make every font range customizable
-  const std::wstring _mainFontFace = L"_InvalidFontName_";
-  DWRITE_FONT_WEIGHT fontWeight = DWRITE_FONT_WEIGHT_NORMAL;
-  DWRITE_FONT_STYLE fontStyle = DWRITE_FONT_STYLE_NORMAL;
+HRESULT DirectWriteResources::_GetTextFormat(
+    const std::wstring& font_face,
+    const int& font_point,
+    const DWRITE_WORD_WRAPPING& wrapping,
+    const bool& vertical_text,
+    ComPtr<IDWriteTextFormat1>& textFormat) {
+  DWRITE_FLOW_DIRECTION flow = _style.vertical_text_left_to_right
+                                   ? DWRITE_FLOW_DIRECTION_LEFT_TO_RIGHT
+                                   : DWRITE_FLOW_DIRECTION_RIGHT_TO_LEFT;
   // convert percentage to float
-  float linespacing = dpiScaleFontPoint * ((float)_style.linespacing / 100.0f);
-  float baseline = dpiScaleFontPoint * ((float)_style.baseline / 100.0f);
-  if (_style.layout_type == UIStyle::LAYOUT_VERTICAL_TEXT)
-    baseline = linespacing / 2;
+  float linespacing = 0, baseline = 0;
+  if (_style.linespacing && _style.baseline) {
+    linespacing = dpiScaleFontPoint * ((float)_style.linespacing / 100.0f);
+    baseline = dpiScaleFontPoint * ((float)_style.baseline / 100.0f);
+    if (_style.layout_type == UIStyle::LAYOUT_VERTICAL_TEXT)
+      baseline = linespacing / 2;
+  }
+  // flow direction only matters to vertical text
+  if (!vertical_text)
+    flow = DWRITE_FLOW_DIRECTION_TOP_TO_BOTTOM;
+  TextFormatKey key{font_face, font_point,    dpiScaleFontPoint,
+                    wrapping,  vertical_text, flow,
+                    linespacing, baseline};
+  std::lock_guard<std::mutex> lock(_textFormatMutex);
+  auto it = _textFormatIndex.find(key);
+  if (it != _textFormatIndex.end()) {
+    _textFormats.splice(_textFormats.begin(), _textFormats, it->second);
+    textFormat = it->second->second;
+    return S_OK;
+  }
+
   // setup font weight and font style by the first unit of font_face setting
   // string
+  DWRITE_FONT_WEIGHT fontWeight = DWRITE_FONT_WEIGHT_NORMAL;
+  DWRITE_FONT_STYLE fontStyle = DWRITE_FONT_STYLE_NORMAL;
   _ParseFontFace(font_face, fontWeight, fontStyle);
+  std::vector<std::wstring> fontFaceStrVector = ws_split(font_face, L",");
   fontFaceStrVector[0] =
       std::regex_replace(fontFaceStrVector[0],
                          std::wregex(STYLEORWEIGHT, std::wregex::icase), L"");
-  hResult = pDWFactory->CreateTextFormat(
-      _mainFontFace.c_str(), NULL, fontWeight, fontStyle,
-      DWRITE_FONT_STRETCH_NORMAL, font_point * dpiScaleFontPoint, L"",
-      reinterpret_cast<IDWriteTextFormat**>(pTextFormat.GetAddressOf()));
-  if (pTextFormat != NULL) {
-    if (vertical_text) {
-      pTextFormat->SetFlowDirection(flow);
-      pTextFormat->SetReadingDirection(DWRITE_READING_DIRECTION_TOP_TO_BOTTOM);
-      pTextFormat->SetTextAlignment(DWRITE_TEXT_ALIGNMENT_LEADING);
-    } else
-      pTextFormat->SetTextAlignment(DWRITE_TEXT_ALIGNMENT_LEADING);
-
-    pTextFormat->SetParagraphAlignment(DWRITE_PARAGRAPH_ALIGNMENT_CENTER);
-    pTextFormat->SetWordWrapping(wrapping);
-    _SetFontFallback(pTextFormat, fontFaceStrVector);
-    if (_style.linespacing && _style.baseline)
-      pTextFormat->SetLineSpacing(DWRITE_LINE_SPACING_METHOD_UNIFORM,
-                                  font_point * linespacing,
-                                  font_point * baseline);
-  }
-  decltype(fontFaceStrVector)().swap(fontFaceStrVector);
-
-  fontFaceStrVector = ws_split(font_face, L",");
-  //_ParseFontFace(fontFaceStrVector[0], fontWeight, fontStyle);
-  fontFaceStrVector[0] =
-      std::regex_replace(fontFaceStrVector[0],
-                         std::wregex(STYLEORWEIGHT, std::wregex::icase), L"");
-  hResult = pDWFactory->CreateTextFormat(
+  // set main font a invalid font name, to make every font range customizable
+  const std::wstring _mainFontFace = L"_InvalidFontName_";
+  HRESULT hResult = pDWFactory->CreateTextFormat(
       _mainFontFace.c_str(), NULL, fontWeight, fontStyle,
       DWRITE_FONT_STRETCH_NORMAL, font_point * dpiScaleFontPoint, L"",
-      reinterpret_cast<IDWriteTextFormat**>(pPreeditTextFormat.GetAddressOf()));
-  if (pPreeditTextFormat != NULL) {
-    if (vertical_text) {
-      pPreeditTextFormat->SetFlowDirection(flow);
-      pPreeditTextFormat->SetReadingDirection(
-          DWRITE_READING_DIRECTION_TOP_TO_BOTTOM);
-      pPreeditTextFormat->SetTextAlignment(DWRITE_TEXT_ALIGNMENT_LEADING);
-    } else
-      pPreeditTextFormat->SetTextAlignment(DWRITE_TEXT_ALIGNMENT_LEADING);
-    pPreeditTextFormat->SetParagraphAlignment(
-        DWRITE_PARAGRAPH_ALIGNMENT_CENTER);
-    pPreeditTextFormat->SetWordWrapping(wrapping_preedit);
-    _SetFontFallback(pPreeditTextFormat, fontFaceStrVector);
-    if (_style.linespacing && _style.baseline)
-      pPreeditTextFormat->SetLineSpacing(DWRITE_LINE_SPACING_METHOD_UNIFORM,
-                                         font_point * linespacing,
-                                         font_point * baseline);
+      reinterpret_cast<IDWriteTextFormat**>(textFormat.GetAddressOf()));
+  if (textFormat == NULL)
+    return hResult;
+  if (vertical_text) {
+    textFormat->SetFlowDirection(flow);
+    textFormat->SetReadingDirection(DWRITE_READING_DIRECTION_TOP_TO_BOTTOM);
   }
-  decltype(fontFaceStrVector)().swap(fontFaceStrVector);
+  textFormat->SetTextAlignment(DWRITE_TEXT_ALIGNMENT_LEADING);
+  textFormat->SetParagraphAlignment(DWRITE_PARAGRAPH_ALIGNMENT_CENTER);
+  textFormat->SetWordWrapping(wrapping);
+  _SetFontFallback(textFormat, fontFaceStrVector);
+  if (_style.linespacing && _style.baseline)
+    textFormat->SetLineSpacing(DWRITE_LINE_SPACING_METHOD_UNIFORM,
+                               font_point * linespacing,
+                               font_point * baseline);
 
-  // label font text format set up
-  fontFaceStrVector = ws_split(label_font_face, L",");
-  // setup weight and style of label_font_face
-  _ParseFontFace(label_font_face, fontWeight, fontStyle);
-  fontFaceStrVector[0] =
-      std::regex_replace(fontFaceStrVector[0],
-                         std::wregex(STYLEORWEIGHT, std::wregex::icase), L"");
-  hResult = pDWFactory->CreateTextFormat(
-      _mainFontFace.c_str(), NULL, fontWeight, fontStyle,
-      DWRITE_FONT_STRETCH_NORMAL, label_font_point * dpiScaleFontPoint, L"",
-      reinterpret_cast<IDWriteTextFormat**>(pLabelTextFormat.GetAddressOf()));
-  if (pLabelTextFormat != NULL) {
-    if (vertical_text) {
-      pLabelTextFormat->SetFlowDirection(flow);
-      pLabelTextFormat->SetReadingDirection(
-          DWRITE_READING_DIRECTION_TOP_TO_BOTTOM);
-      pLabelTextFormat->SetTextAlignment(DWRITE_TEXT_ALIGNMENT_LEADING);
-    } else
-      pLabelTextFormat->SetTextAlignment(DWRITE_TEXT_ALIGNMENT_LEADING);
-    pLabelTextFormat->SetParagraphAlignment(DWRITE_PARAGRAPH_ALIGNMENT_CENTER);
-    pLabelTextFormat->SetWordWrapping(wrapping);
-    _SetFontFallback(pLabelTextFormat, fontFaceStrVector);
-    if (_style.linespacing && _style.baseline)
-      pLabelTextFormat->SetLineSpacing(DWRITE_LINE_SPACING_METHOD_UNIFORM,
-                                       label_font_point * linespacing,
-                                       label_font_point * baseline);
+  _textFormats.emplace_front(key, textFormat);
+  _textFormatIndex[key] = _textFormats.begin();
+  if (_textFormats.size() > MAX_CACHED_TEXT_FORMATS) {
+    _textFormatIndex.erase(_textFormats.back().first);
+    _textFormats.pop_back();
   }
-  decltype(fontFaceStrVector)().swap(fontFaceStrVector);
-
-  // comment font text format set up
-  fontFaceStrVector = ws_split(comment_font_face, L",");
-  // setup weight and style of label_font_face
-  _ParseFontFace(comment_font_face, fontWeight, fontStyle);
-  fontFaceStrVector[0] =
-      std::regex_replace(fontFaceStrVector[0],
-                         std::wregex(STYLEORWEIGHT, std::wregex::icase), L"");
-  hResult = pDWFactory->CreateTextFormat(
-      _mainFontFace.c_str(), NULL, fontWeight, fontStyle,
-      DWRITE_FONT_STRETCH_NORMAL, comment_font_point * dpiScaleFontPoint, L"",
-      reinterpret_cast<IDWriteTextFormat**>(pCommentTextFormat.GetAddressOf()));
-  if (pCommentTextFormat != NULL) {
-    if (vertical_text) {
-      pCommentTextFormat->SetFlowDirection(flow);
-      pCommentTextFormat->SetReadingDirection(
-          DWRITE_READING_DIRECTION_TOP_TO_BOTTOM);
-      pCommentTextFormat->SetTextAlignment(DWRITE_TEXT_ALIGNMENT_LEADING);
-    } else
-      pCommentTextFormat->SetTextAlignment(DWRITE_TEXT_ALIGNMENT_LEADING);
-    pCommentTextFormat->SetParagraphAlignment(
-        DWRITE_PARAGRAPH_ALIGNMENT_CENTER);
-    pCommentTextFormat->SetWordWrapping(wrapping);
-    _SetFontFallback(pCommentTextFormat, fontFaceStrVector);
-    if (_style.linespacing && _style.baseline)
-      pCommentTextFormat->SetLineSpacing(DWRITE_LINE_SPACING_METHOD_UNIFORM,
-                                         comment_font_point * linespacing,
-                                         comment_font_point * baseline);
-  }
-  decltype(fontFaceStrVector)().swap(fontFaceStrVector);
   return hResult;
 }
 
@@ -275,6 +259,56 @@ void weasel::DirectWriteResources::SetDpi(const UINT& dpi) {
   InitResources(_style);
 }
 
+// enough for a few pages of candidates with labels and comments
+static const size_t MAX_CACHED_TEXT_SIZES = 512;
+
+bool DirectWriteResources::FindTextSize(const TextSizeKey& key, SIZE* size) {
+  auto it = _textSizeIndex.find(key);
+  if (it == _textSizeIndex.end())
+    return false;
+  _textSizes.splice(_textSizes.begin(), _textSizes, it->second);
+  *size = it->second->second;
+  return true;
+}
+
+void DirectWriteResources::CacheTextSize(const TextSizeKey& key,
+                                         const SIZE& size) {
+  auto it = _textSizeIndex.find(key);
+  if (it != _textSizeIndex.end()) {
+    it->second->second = size;
+    _textSizes.splice(_textSizes.begin(), _textSizes, it->second);
+    return;
+  }
+  _textSizes.emplace_front(key, size);
+  _textSizeIndex[key] = _textSizes.begin();
+  if (_textSizes.size() > MAX_CACHED_TEXT_SIZES) {
+    _textSizeIndex.erase(_textSizes.back().first);
+    _textSizes.pop_back();
+  }
+}
+
+// select labels, a mark or two, for each label and text format in use
+static const size_t MAX_STATIC_TEXT_LAYOUTS = 64;
+
+ComPtr<IDWriteTextLayout2> DirectWriteResources::GetStaticTextLayout(
+    const std::wstring& text,
+    IDWriteTextFormat1* format) {
+  auto key = std::make_pair(text, format);
+  auto it = _staticTextLayouts.find(key);
+  if (it != _staticTextLayouts.end())
+    return it->second;
+  ComPtr<IDWriteTextLayout2> layout;
+  // max width / height are set by the caller before each use
+  if (FAILED(pDWFactory->CreateTextLayout(
+          text.c_str(), (UINT32)text.length(), format, 0.0f, 0.0f,
+          reinterpret_cast<IDWriteTextLayout**>(layout.GetAddressOf()))))
+    return ComPtr<IDWriteTextLayout2>();
+  if (_staticTextLayouts.size() >= MAX_STATIC_TEXT_LAYOUTS)
+    _staticTextLayouts.clear();
+  _staticTextLayouts[key] = layout;
+  return layout;
+}
+
 static std::wstring _MatchWordsOutLowerCaseTrim1st(const std::wstring& wstr,
                                                    const std::wstring& pat) {
   std::wstring mat = L"";
@@ -338,6 +372,16 @@ void DirectWriteResources::_ParseFontFace(const std::wstring& fontFaceStr,
 void DirectWriteResources::_SetFontFallback(
     ComPtr<IDWriteTextFormat1> textFormat,
     const std::vector<std::wstring>& fontVector) {
+  // the same fallback is shared by formats of every size, called with
+  // _textFormatMutex held
+  std::wstring fallbackKey;
+  for (const auto& font : fontVector)
+    fallbackKey += font + L",";
+  auto it = _fontFallbacks.find(fallbackKey);
+  if (it != _fontFallbacks.end()) {
+    textFormat->SetFontFallback(it->second.Get());
+    return;
+  }
   ComPtr<IDWriteFontFallback> pSysFallback;
   pDWFactory->GetSystemFontFallback(pSysFallback.GetAddressOf());
   ComPtr<IDWriteFontFallback> pFontFallback = NULL;
@@ -389,6 +433,9 @@ void DirectWriteResources::_SetFontFallback(
   pFontFallbackBuilder->AddMappings(pSysFallback.Get());
   pFontFallbackBuilder->CreateFontFallback(pFontFallback.GetAddressOf());
   textFormat->SetFontFallback(pFontFallback.Get());
+  if (_fontFallbacks.size() >= MAX_CACHED_TEXT_FORMATS)
+    _fontFallbacks.clear();
+  _fontFallbacks[fallbackKey] = pFontFallback;
   decltype(fallbackFontsVector)().swap(fallbackFontsVector);
   pFontFallback.Reset();
   pSysFallback.Reset();
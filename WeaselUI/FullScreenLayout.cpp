@@ -21,32 +21,9 @@ void weasel::FullScreenLayout::DoLayout(CDCHandle dc, PDWR pDWR) {
     }
   }
 
-  int step = 32;
-  do {
-    m_layout->DoLayout(dc, pDWR);
-    if ((_style.hilited_mark_color & 0xff000000)) {
-      CSize sg;
-      if (candidates_count) {
-        if (_style.mark_text.empty())
-          GetTextSizeDW(L"|", 1, pDWR->pTextFormat, pDWR, &sg);
-        else
-          GetTextSizeDW(_style.mark_text, _style.mark_text.length(),
-                        pDWR->pTextFormat, pDWR, &sg);
-      }
-      mark_width = sg.cx;
-      mark_height = sg.cy;
-      if (_style.mark_text.empty()) {
-        mark_width = mark_height / 7;
-        if (_style.linespacing && _style.baseline)
-          mark_width =
-              (int)((float)mark_width / ((float)_style.linespacing / 100.0f));
-        mark_width = max(mark_width, 6);
-      }
-      mark_gap = (_style.mark_text.empty())
-                     ? mark_width
-                     : mark_width + _style.hilite_spacing;
-    }
-  } while (AdjustFontPoint(dc, workArea, step, pDWR));
+  m_layout->DoLayout(dc, pDWR);
+  _UpdateMark();
+  AdjustFontPoint(dc, workArea, pDWR);
 
   int offsetx = (workArea.Width() - m_layout->GetContentSize().cx) / 2;
   int offsety = (workArea.Height() - m_layout->GetContentSize().cy) / 2;
@@ -80,59 +57,116 @@ void weasel::FullScreenLayout::DoLayout(CDCHandle dc, PDWR pDWR) {
   _contentRect.DeflateRect(offsetX, offsetY);
 }
 
-bool FullScreenLayout::AdjustFontPoint(CDCHandle dc,
+void FullScreenLayout::_UpdateMark() {
+  if ((_style.hilited_mark_color & 0xff000000)) {
+    CSize sg;
+    if (candidates_count) {
+      if (_style.mark_text.empty())
+        GetTextSize(L"|", 1, TEXT_FONT, &sg);
+      else
+        GetTextSize(_style.mark_text, _style.mark_text.length(), TEXT_FONT,
+                    &sg);
+    }
+    mark_width = sg.cx;
+    mark_height = sg.cy;
+    if (_style.mark_text.empty()) {
+      mark_width = mark_height / 7;
+      if (_style.linespacing && _style.baseline)
+        mark_width =
+            (int)((float)mark_width / ((float)_style.linespacing / 100.0f));
+      mark_width = max(mark_width, 6);
+    }
+    mark_gap = (_style.mark_text.empty()) ? mark_width
+                                          : mark_width + _style.hilite_spacing;
+  }
+}
+
+static int _FontPoint(const ComPtr<IDWriteTextFormat1>& format, PDWR pDWR) {
+  if (format == NULL)
+    return 0;
+  return (int)(format->GetFontSize() / pDWR->dpiScaleFontPoint);
+}
+
+// text extents scale about linearly with the font point: estimate the point
+// filling the work area from the current layout, then correct it once with
+// the secant through both measurements, bisecting only should that overflow.
+// The point left in pDWR serves as the cached result for the next context,
+// which usually needs no rebuild at all.
+void FullScreenLayout::AdjustFontPoint(CDCHandle dc,
                                        const CRect& workArea,
-                                       int& step,
                                        PDWR pDWR) {
-  if (_context.empty() || step == 0)
-    return false;
-  {
-    int fontPointLabel;
-    int fontPoint;
-    int fontPointComment;
+  if (_context.empty())
+    return;
+  const int availX = workArea.Width() - offsetX * 2;
+  const int availY = workArea.Height() - offsetY * 2;
+  if (availX <= 0 || availY <= 0)
+    return;
+  auto fits = [&](const CSize& sz) {
+    return sz.cx <= availX && sz.cy <= availY;
+  };
+  auto fills = [&](const CSize& sz) {
+    return sz.cx > availX * 31 / 32 || sz.cy > availY * 31 / 32;
+  };
 
-    if (pDWR->pLabelTextFormat != NULL)
-      fontPointLabel = (int)(pDWR->pLabelTextFormat->GetFontSize() /
-                             pDWR->dpiScaleFontPoint);
-    else
-      fontPointLabel = 0;
-    if (pDWR->pTextFormat != NULL)
-      fontPoint =
-          (int)(pDWR->pTextFormat->GetFontSize() / pDWR->dpiScaleFontPoint);
-    else
-      fontPoint = 0;
-    if (pDWR->pCommentTextFormat != NULL)
-      fontPointComment = (int)(pDWR->pCommentTextFormat->GetFontSize() /
-                               pDWR->dpiScaleFontPoint);
-    else
-      fontPointComment = 0;
-    CSize sz = m_layout->GetContentSize();
-    if (sz.cx > workArea.Width() - offsetX * 2 ||
-        sz.cy > workArea.Height() - offsetY * 2) {
-      if (step > 0) {
-        step = -(step >> 1);
-      }
-      fontPoint += step;
-      fontPointLabel += step;
-      fontPointComment += step;
-      pDWR->InitResources(_style.label_font_face, fontPointLabel,
-                          _style.font_face, fontPoint, _style.comment_font_face,
-                          fontPointComment);
-      return true;
-    } else if (sz.cx <= (workArea.Width() - offsetX * 2) * 31 / 32 &&
-               sz.cy <= (workArea.Height() - offsetY * 2) * 31 / 32) {
-      if (step < 0) {
-        step = -step >> 1;
-      }
-      fontPoint += step;
-      fontPointLabel += step;
-      fontPointComment += step;
-      pDWR->InitResources(_style.label_font_face, fontPointLabel,
-                          _style.font_face, fontPoint, _style.comment_font_face,
-                          fontPointComment);
-      return true;
-    }
+  const int fontPointLabel = _FontPoint(pDWR->pLabelTextFormat, pDWR);
+  const int fontPoint = _FontPoint(pDWR->pTextFormat, pDWR);
+  const int fontPointComment = _FontPoint(pDWR->pCommentTextFormat, pDWR);
+  // all fonts are shifted by the same number of points, as before
+  auto layout_at = [&](int point) {
+    int step = point - fontPoint;
+    pDWR->InitResources(_style.label_font_face, fontPointLabel + step,
+                        _style.font_face, point, _style.comment_font_face,
+                        fontPointComment + step);
+    m_layout->DoLayout(dc, pDWR);
+    _UpdateMark();
+    return m_layout->GetContentSize();
+  };
 
-    return false;
+  CSize sz0 = m_layout->GetContentSize();
+  if (fontPoint <= 0 || (fits(sz0) && fills(sz0)))
+    return;
+  double scale = min((double)availX / max(sz0.cx, 1L),
+                     (double)availY / max(sz0.cy, 1L));
+  int point1 = max((int)(fontPoint * scale), 1);
+  if (point1 == fontPoint)
+    point1 = fits(sz0) ? fontPoint + 1 : max(fontPoint - 1, 1);
+  if (point1 == fontPoint)
+    return;
+  CSize sz1 = layout_at(point1);
+  if (fits(sz1) && fills(sz1))
+    return;
+
+  // corrective pass, fixed margins and spacing make the scale inexact
+  auto secant = [&](int avail, int size0, int size1) {
+    return (int)(fontPoint + (double)(avail - size0) * (point1 - fontPoint) /
+                                 (size1 - size0));
+  };
+  int point2 = point1;
+  if (sz1.cx != sz0.cx && sz1.cy != sz0.cy)
+    point2 = min(secant(availX, sz0.cx, sz1.cx),
+                 secant(availY, sz0.cy, sz1.cy));
+  else if (sz1.cx != sz0.cx)
+    point2 = secant(availX, sz0.cx, sz1.cx);
+  else if (sz1.cy != sz0.cy)
+    point2 = secant(availY, sz0.cy, sz1.cy);
+  point2 = max(point2, 1);
+  CSize sz2 = point2 == point1 ? sz1 : layout_at(point2);
+  if (fits(sz2))
+    return;
+  // never overflow the work area: bisect between the largest point measured
+  // to fit and point2
+  int good = 1, bad = point2, last = point2;
+  if (fits(sz0) && fontPoint < bad)
+    good = max(good, fontPoint);
+  if (fits(sz1) && point1 < bad)
+    good = max(good, point1);
+  while (bad - good > 1) {
+    last = good + (bad - good) / 2;
+    if (fits(layout_at(last)))
+      good = last;
+    else
+      bad = last;
   }
+  if (last != good)
+    layout_at(good);
 }
@@ -16,13 +16,31 @@ class FullScreenLayout : public StandardLayout {
         m_layout(layout) {}
   virtual ~FullScreenLayout() { delete m_layout; }
 
+  virtual void Rebind(const UIStyle& style, PDWR pDWR) {
+    StandardLayout::Rebind(style, pDWR);
+    m_layout->Rebind(style, pDWR);
+  }
+
   virtual void DoLayout(CDCHandle dc, PDWR pDWR = NULL);
+  // font point is fitted to the whole content, always lay out again
+  virtual bool UpdateHighlight() { return false; }
+  virtual void SetTextMeasurer(TextMeasurer* measurer) {
+    StandardLayout::SetTextMeasurer(measurer);
+    m_layout->SetTextMeasurer(measurer);
+  }
+  virtual ComPtr<IDWriteTextLayout2> GetTextLayout(
+      const std::wstring& text,
+      size_t nCount,
+      IDWriteTextFormat1* pTextFormat,
+      PDWR pDWR) const {
+    return m_layout->GetTextLayout(text, nCount, pTextFormat, pDWR);
+  }
 
  private:
-  bool AdjustFontPoint(CDCHandle dc,
+  void AdjustFontPoint(CDCHandle dc,
                        const CRect& workArea,
-                       int& step,
                        PDWR pDWR = NULL);
+  void _UpdateMark();
 
   const CRect& mr_inputPos;
   Layout* m_layout;
@@ -1,5 +1,12 @@
 #include "stdafx.h"
 #include "GdiplusBlur.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+#if defined(_M_IX86) || defined(_M_X64)
+#include <emmintrin.h>
+#define WEASEL_BLUR_SSE2
+#endif
 
 namespace weasel {
 /* start image gauss blur functions from
@@ -261,6 +268,214 @@ void boxBlurT_4(BYTE* scl,
   }
 }
 
+/* end of the scalar kernels, kept as the reference for the SSE2 ones */
+
+// bitmaps smaller than this are blurred on the calling thread
+static const int kParallelBlurPixels = 256 * 256;
+
+static int _BlurThreads(int w, int h) {
+  if (w * h < kParallelBlurPixels)
+    return 1;
+  int n = (int)std::thread::hardware_concurrency();
+  return max(1, min(n, 4));
+}
+
+template <typename F>
+struct _ParallelJob {
+  _ParallelJob(const F& f, int n, int chunk) : f(f), n(n), chunk(chunk) {}
+  const F& f;
+  const int n;
+  const int chunk;
+  std::atomic<int> next{0};
+};
+
+// takes chunks until none is left, on the caller and the pool workers alike
+template <typename F>
+static void CALLBACK _RunChunks(PTP_CALLBACK_INSTANCE instance,
+                                PVOID context,
+                                PTP_WORK work) {
+  _ParallelJob<F>* job = (_ParallelJob<F>*)context;
+  for (int begin; (begin = job->next.fetch_add(job->chunk)) < job->n;)
+    job->f(begin, min(job->n, begin + job->chunk));
+}
+
+// runs f(begin, end) over [0, n) split into `threads` chunks; the workers
+// come from the process thread pool, a blur does not start any threads
+template <typename F>
+static void _ParallelFor(int n, int threads, const F& f) {
+  threads = min(threads, n);
+  _ParallelJob<F> job(f, n, (n + threads - 1) / max(threads, 1));
+  PTP_WORK work = threads > 1
+                      ? CreateThreadpoolWork(&_RunChunks<F>, &job, NULL)
+                      : NULL;
+  if (!work) {
+    f(0, n);
+    return;
+  }
+  for (int i = 1; i < threads; ++i)
+    SubmitThreadpoolWork(work);
+  _RunChunks<F>(NULL, &job, work);
+  WaitForThreadpoolWorkCallbacks(work, FALSE);
+  CloseThreadpoolWork(work);
+}
+
+#ifdef WEASEL_BLUR_SSE2
+// loads `count` (1 to 4) BGRA pixels, each widened to 4 int32 lanes
+template <int N>
+static inline void _LoadPixels(const BYTE* p, int count, __m128i* px) {
+  const __m128i zero = _mm_setzero_si128();
+  if (N == 1) {
+    __m128i v = _mm_cvtsi32_si128(*(const int*)p);
+    px[0] = _mm_unpacklo_epi16(_mm_unpacklo_epi8(v, zero), zero);
+    return;
+  }
+  __m128i v;
+  if (count == 4) {
+    v = _mm_loadu_si128((const __m128i*)p);
+  } else {
+    alignas(16) BYTE buf[16] = {0};
+    memcpy(buf, p, count * 4);
+    v = _mm_load_si128((const __m128i*)buf);
+  }
+  __m128i lo = _mm_unpacklo_epi8(v, zero);
+  __m128i hi = _mm_unpackhi_epi8(v, zero);
+  px[0] = _mm_unpacklo_epi16(lo, zero);
+  px[1] = _mm_unpackhi_epi16(lo, zero);
+  px[2] = _mm_unpacklo_epi16(hi, zero);
+  px[3] = _mm_unpackhi_epi16(hi, zero);
+}
+
+// same rounding as myround(val * iarr) in the scalar kernels
+template <int N>
+static inline void _StorePixels(BYTE* p,
+                                int count,
+                                const __m128i* val,
+                                const __m128& iarr) {
+  const __m128 half = _mm_set1_ps(0.5f);
+  __m128i o[4];
+  for (int k = 0; k < N; ++k)
+    o[k] = _mm_cvttps_epi32(
+        _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(val[k]), iarr), half));
+  for (int k = N; k < 4; ++k)
+    o[k] = _mm_setzero_si128();
+  __m128i v = _mm_packus_epi16(_mm_packs_epi32(o[0], o[1]),
+                               _mm_packs_epi32(o[2], o[3]));
+  if (N == 1) {
+    *(int*)p = _mm_cvtsi128_si32(v);
+  } else if (count == 4) {
+    _mm_storeu_si128((__m128i*)p, v);
+  } else {
+    alignas(16) BYTE buf[16];
+    _mm_store_si128((__m128i*)buf, v);
+    memcpy(p, buf, count * 4);
+  }
+}
+
+// blurs `count` adjacent pixels along a line of `len` samples placed `step`
+// bytes apart, mirroring the scalar running sum step by step
+template <int N>
+static void _BoxBlurLine(const BYTE* scl,
+                         BYTE* tcl,
+                         int len,
+                         int r,
+                         int step,
+                         int count,
+                         const __m128& iarr) {
+  __m128i fv[4], lv[4], val[4], a[4], b[4];
+  _LoadPixels<N>(scl, count, fv);
+  _LoadPixels<N>(scl + (len - 1) * step, count, lv);
+  // lanes hold values below 2^16, so madd multiplies them by r + 1
+  const __m128i r1 = _mm_set1_epi32(r + 1);
+  for (int k = 0; k < N; ++k)
+    val[k] = _mm_madd_epi16(fv[k], r1);
+
+  for (int j = 0; j < r; ++j) {
+    _LoadPixels<N>(scl + j * step, count, a);
+    for (int k = 0; k < N; ++k)
+      val[k] = _mm_add_epi32(val[k], a[k]);
+  }
+
+  int ti = 0, li = 0, ri = r * step;
+  for (int j = 0; j <= r; ++j) {
+    _LoadPixels<N>(scl + ri, count, a);
+    for (int k = 0; k < N; ++k)
+      val[k] = _mm_add_epi32(val[k], _mm_sub_epi32(a[k], fv[k]));
+    _StorePixels<N>(tcl + ti, count, val, iarr);
+    ri += step;
+    ti += step;
+  }
+
+  for (int j = r + 1; j < len - r; ++j) {
+    _LoadPixels<N>(scl + ri, count, a);
+    _LoadPixels<N>(scl + li, count, b);
+    for (int k = 0; k < N; ++k)
+      val[k] = _mm_add_epi32(val[k], _mm_sub_epi32(a[k], b[k]));
+    _StorePixels<N>(tcl + ti, count, val, iarr);
+    ri += step;
+    li += step;
+    ti += step;
+  }
+
+  for (int j = len - r; j < len; ++j) {
+    _LoadPixels<N>(scl + li, count, b);
+    for (int k = 0; k < N; ++k)
+      val[k] = _mm_add_epi32(val[k], _mm_sub_epi32(lv[k], b[k]));
+    _StorePixels<N>(tcl + ti, count, val, iarr);
+    li += step;
+    ti += step;
+  }
+}
+#endif
+
+static void _BoxBlurH(BYTE* scl,
+                      BYTE* tcl,
+                      int w,
+                      int h,
+                      int r,
+                      int bpp,
+                      int stride) {
+  int threads = _BlurThreads(w, h);
+#ifdef WEASEL_BLUR_SSE2
+  const __m128 iarr = _mm_set1_ps((float)(1. / ((LONGLONG)r + r + 1)));
+  _ParallelFor(h, threads, [=](int begin, int end) {
+    for (int i = begin; i < end; ++i)
+      _BoxBlurLine<1>(scl + i * stride, tcl + i * stride, w, r, bpp, 1, iarr);
+  });
+#else
+  _ParallelFor(h, threads, [=](int begin, int end) {
+    boxBlurH_4(scl + begin * stride, tcl + begin * stride, w, end - begin, r,
+               bpp, stride);
+  });
+#endif
+}
+
+// the vertical pass walks blocks of 4 columns, so each row access reads
+// 16 contiguous bytes instead of striding over single pixels
+static void _BoxBlurT(BYTE* scl,
+                      BYTE* tcl,
+                      int w,
+                      int h,
+                      int r,
+                      int bpp,
+                      int stride) {
+  int threads = _BlurThreads(w, h);
+#ifdef WEASEL_BLUR_SSE2
+  const __m128 iarr = _mm_set1_ps((float)(1.0f / (r + r + 1.0f)));
+  _ParallelFor((w + 3) / 4, threads, [=](int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+      int x = i * 4;
+      _BoxBlurLine<4>(scl + x * bpp, tcl + x * bpp, h, r, stride,
+                      min(4, w - x), iarr);
+    }
+  });
+#else
+  _ParallelFor(w, threads, [=](int begin, int end) {
+    boxBlurT_4(scl + begin * bpp, tcl + begin * bpp, end - begin, h, r, bpp,
+               stride);
+  });
+#endif
+}
+
 void boxBlur_4(BYTE* scl,
                BYTE* tcl,
                int w,
@@ -270,8 +485,8 @@ void boxBlur_4(BYTE* scl,
                int bpp,
                int stride) {
   memcpy(tcl, scl, stride * h);
-  boxBlurH_4(tcl, scl, w, h, rx, bpp, stride);
-  boxBlurT_4(scl, tcl, w, h, ry, bpp, stride);
+  _BoxBlurH(tcl, scl, w, h, rx, bpp, stride);
+  _BoxBlurT(scl, tcl, w, h, ry, bpp, stride);
 }
 
 void gaussBlur_4(BYTE* scl,
@@ -3,5 +3,16 @@
 #pragma comment(lib, "gdiplus.lib")
 
 namespace weasel {
+// scalar reference passes, and the dispatched pass boxBlur_4 must match
+void boxBlurH_4(BYTE* scl, BYTE* tcl, int w, int h, int r, int bpp, int stride);
+void boxBlurT_4(BYTE* scl, BYTE* tcl, int w, int h, int r, int bpp, int stride);
+void boxBlur_4(BYTE* scl,
+               BYTE* tcl,
+               int w,
+               int h,
+               int rx,
+               int ry,
+               int bpp,
+               int stride);
 void DoGaussianBlur(Gdiplus::Bitmap* img, float radiusX, float radiusY);
 }
@@ -1,5 +1,6 @@
 #include "stdafx.h"
 #include "HorizontalLayout.h"
+#include <climits>
 
 using namespace weasel;
 
@@ -13,10 +14,10 @@ void HorizontalLayout::DoLayout(CDCHandle dc, PDWR pDWR) {
     CSize sg;
     if (candidates_count) {
       if (_style.mark_text.empty())
-        GetTextSizeDW(L"|", 1, pDWR->pTextFormat, pDWR, &sg);
+        GetTextSize(L"|", 1, TEXT_FONT, &sg);
       else
-        GetTextSizeDW(_style.mark_text, _style.mark_text.length(),
-                      pDWR->pTextFormat, pDWR, &sg);
+        GetTextSize(_style.mark_text, _style.mark_text.length(), TEXT_FONT,
+                    &sg);
     }
 
     mark_width = sg.cx;
@@ -36,8 +37,8 @@ void HorizontalLayout::DoLayout(CDCHandle dc, PDWR pDWR) {
   // calc page indicator
   CSize pgszl, pgszr;
   if (!IsInlinePreedit()) {
-    GetTextSizeDW(pre, pre.length(), pDWR->pPreeditTextFormat, pDWR, &pgszl);
-    GetTextSizeDW(next, next.length(), pDWR->pPreeditTextFormat, pDWR, &pgszr);
+    GetTextSize(pre, pre.length(), PREEDIT_FONT, &pgszl);
+    GetTextSize(next, next.length(), PREEDIT_FONT, &pgszr);
   }
   bool page_en = (_style.prevpage_color & 0xff000000) &&
                  (_style.nextpage_color & 0xff000000);
@@ -48,7 +49,7 @@ void HorizontalLayout::DoLayout(CDCHandle dc, PDWR pDWR) {
 
   /* Preedit */
   if (!IsInlinePreedit() && !_context.preedit.str.empty()) {
-    size = GetPreeditSize(dc, _context.preedit, pDWR->pPreeditTextFormat, pDWR);
+    size = GetPreeditSize(dc, _context.preedit, PREEDIT_FONT);
     int szx = pgw, szy = max(size.cy, pgh);
     // icon size higher then preedit text
     int yoffset = (STATUS_ICON_SIZE >= szy && ShouldDisplayStatusIcon())
@@ -64,7 +65,7 @@ void HorizontalLayout::DoLayout(CDCHandle dc, PDWR pDWR) {
 
   /* Auxiliary */
   if (!_context.aux.str.empty()) {
-    size = GetPreeditSize(dc, _context.aux, pDWR->pPreeditTextFormat, pDWR);
+    size = GetPreeditSize(dc, _context.aux, PREEDIT_FONT);
     // icon size higher then auxiliary text
     int yoffset = (STATUS_ICON_SIZE >= size.cy && ShouldDisplayStatusIcon())
                       ? (STATUS_ICON_SIZE - size.cy) / 2
@@ -82,30 +83,29 @@ void HorizontalLayout::DoLayout(CDCHandle dc, PDWR pDWR) {
   int mintop_of_rows[MAX_CANDIDATES_COUNT] = {0};
   // only when there are candidates
   if (candidates_count) {
-    w = offsetX + real_margin_x;
-    for (auto i = 0; i < candidates_count && i < MAX_CANDIDATES_COUNT; ++i) {
-      int current_cand_width = 0;
-      if (i > 0)
-        w += _style.candidate_spacing;
+    const int count = min(candidates_count, MAX_CANDIDATES_COUNT);
+    const int left = offsetX + real_margin_x, top = height;
+    int width_of_candidate[MAX_CANDIDATES_COUNT] = {0};
+    // measure every candidate once, as if it started the first row
+    for (auto i = 0; i < count; ++i) {
+      w = left;
       if (id == i)
         w += base_offset;
       /* Label */
       std::wstring label =
           GetLabelText(labels, i, _style.label_text_format.c_str());
-      GetTextSizeDW(label, label.length(), pDWR->pLabelTextFormat, pDWR, &size);
+      GetTextSize(label, label.length(), LABEL_FONT, &size);
       _candidateLabelRects[i].SetRect(w, height, w + size.cx * labelFontValid,
                                       height + size.cy);
       w += size.cx * labelFontValid;
-      current_cand_width += size.cx * labelFontValid;
 
       /* Text */
       w += _style.hilite_spacing;
       const std::wstring& text = candidates.at(i).str;
-      GetTextSizeDW(text, text.length(), pDWR->pTextFormat, pDWR, &size);
+      GetTextSize(text, text.length(), TEXT_FONT, &size);
       _candidateTextRects[i].SetRect(w, height, w + size.cx * textFontValid,
                                      height + size.cy);
       w += size.cx * textFontValid;
-      current_cand_width += (size.cx + _style.hilite_spacing) * textFontValid;
 
       /* Comment */
       bool cmtFontNotTrans =
@@ -113,54 +113,47 @@ void HorizontalLayout::DoLayout(CDCHandle dc, PDWR pDWR) {
           (i != id && (_style.comment_text_color & 0xff000000));
       if (!comments.at(i).str.empty() && cmtFontValid && cmtFontNotTrans) {
         const std::wstring& comment = comments.at(i).str;
-        GetTextSizeDW(comment, comment.length(), pDWR->pCommentTextFormat, pDWR,
-                      &size);
+        GetTextSize(comment, comment.length(), COMMENT_FONT, &size);
         w += _style.hilite_spacing;
         _candidateCommentRects[i].SetRect(w, height, w + size.cx * cmtFontValid,
                                           height + size.cy);
         w += size.cx * cmtFontValid;
-        current_cand_width += (size.cx + _style.hilite_spacing) * cmtFontValid;
       } else /* Used for highlighted candidate calculation below */
         _candidateCommentRects[i].SetRect(w, height, w, height + size.cy);
+      width_of_candidate[i] = _candidateCommentRects[i].right - left;
+    }
 
-      int base_left = (i == id) ? _candidateLabelRects[i].left - base_offset
-                                : _candidateLabelRects[i].left;
-      // if not the first candidate of current row, and current candidate's
-      // right > _style.max_width
-      if (_style.max_width > 0 && (base_left > real_margin_x + offsetX) &&
-          (_candidateCommentRects[i].right - offsetX + real_margin_x >
-           _style.max_width)) {
-        // max_width_of_rows current row
-        max_width_of_rows =
-            max(max_width_of_rows, _candidateCommentRects[i - 1].right);
-        w = offsetX + real_margin_x + (i == id ? base_offset : 0);
-        int ofx = w - _candidateLabelRects[i].left;
-        int ofy = height_of_rows[row_cnt] + _style.candidate_spacing;
-        // offset rects to next row
-        _candidateLabelRects[i].OffsetRect(ofx, ofy);
-        _candidateTextRects[i].OffsetRect(ofx, ofy);
-        _candidateCommentRects[i].OffsetRect(ofx, ofy);
-        // max width of next row, if it's the last candidate, make sure
-        // max_width_of_rows calc right
-        max_width_of_rows =
-            max(max_width_of_rows, _candidateCommentRects[i].right);
-        mintop_of_rows[row_cnt] = height;
-        height += ofy;
-        // re calc rect position, decrease offsetX for origin
-        w += current_cand_width;
-        row_cnt++;
-      } else
-        max_width_of_rows = max(max_width_of_rows, w);
+    // break them into rows within max_width
+    int limit = _style.max_width > 0 ? _style.max_width - real_margin_x * 2
+                                     : INT_MAX;
+    row_cnt = _BreakLines(width_of_candidate, count, _style.candidate_spacing,
+                          limit, row_of_candidate) -
+              1;
+
+    // and move them to their rows
+    w = left;
+    for (auto i = 0; i < count; ++i) {
+      int row = row_of_candidate[i];
+      if (i > 0 && row != row_of_candidate[i - 1]) {
+        height += height_of_rows[row - 1] + _style.candidate_spacing;
+        w = left;
+      } else if (i > 0)
+        w += _style.candidate_spacing;
+      int ofx = w - left, ofy = height - top;
+      _candidateLabelRects[i].OffsetRect(ofx, ofy);
+      _candidateTextRects[i].OffsetRect(ofx, ofy);
+      _candidateCommentRects[i].OffsetRect(ofx, ofy);
+      w += width_of_candidate[i];
+      max_width_of_rows =
+          max(max_width_of_rows, _candidateCommentRects[i].right);
       // calculate height of current row is the max of three rects
-      mintop_of_rows[row_cnt] = height;
-      height_of_rows[row_cnt] =
-          max(height_of_rows[row_cnt], _candidateLabelRects[i].Height());
-      height_of_rows[row_cnt] =
-          max(height_of_rows[row_cnt], _candidateTextRects[i].Height());
-      height_of_rows[row_cnt] =
-          max(height_of_rows[row_cnt], _candidateCommentRects[i].Height());
-      // set row info of current candidate
-      row_of_candidate[i] = row_cnt;
+      mintop_of_rows[row] = height;
+      height_of_rows[row] =
+          max(height_of_rows[row], _candidateLabelRects[i].Height());
+      height_of_rows[row] =
+          max(height_of_rows[row], _candidateTextRects[i].Height());
+      height_of_rows[row] =
+          max(height_of_rows[row], _candidateCommentRects[i].Height());
     }
 
     // reposition for alignment, exp when rect height not equal to
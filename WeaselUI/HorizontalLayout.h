@@ -11,5 +11,11 @@ class HorizontalLayout : public StandardLayout {
                    PDWR pDWR)
       : StandardLayout(style, context, status, pDWR) {}
   virtual void DoLayout(CDCHandle dc, PDWR pDWR = NULL);
+  virtual bool UpdateHighlight() {
+    // the mark in front of the highlighted candidate shifts the ones after
+    if (_style.hilited_mark_color & 0xff000000)
+      return false;
+    return StandardLayout::UpdateHighlight();
+  }
 };
 };  // namespace weasel
@@ -6,37 +6,51 @@ Layout::Layout(const UIStyle& style,
                const Context& context,
                const Status& status,
                PDWR pDWR)
-    : _style(style),
-      _context(context),
+    : _context(context),
       _status(status),
       candidates(_context.cinfo.candies),
       comments(_context.cinfo.comments),
       labels(_context.cinfo.labels),
       id(_context.cinfo.highlighted),
-      candidates_count((int)candidates.size()),
-      labelFontValid(!!(_style.label_font_point > 0)),
-      textFontValid(!!(_style.font_point > 0)),
-      cmtFontValid(!!(_style.comment_font_point > 0)) {
-  if (pDWR) {
-    float scale = pDWR->dpiScaleLayout;
-    _style.min_width = (int)(_style.min_width * scale);
-    _style.min_height = (int)(_style.min_height * scale);
-    _style.max_width = (int)(_style.max_width * scale);
-    _style.max_height = (int)(_style.max_height * scale);
-    _style.border = (int)(_style.border * scale);
-    _style.margin_x = (int)(_style.margin_x * scale);
-    _style.margin_y = (int)(_style.margin_y * scale);
-    _style.spacing = (int)(_style.spacing * scale);
-    _style.candidate_spacing = (int)(_style.candidate_spacing * scale);
-    _style.hilite_spacing = (int)(_style.hilite_spacing * scale);
-    _style.hilite_padding_x = (int)(_style.hilite_padding_x * scale);
-    _style.hilite_padding_y = (int)(_style.hilite_padding_y * scale);
-    _style.round_corner = (int)(_style.round_corner * scale);
-    _style.round_corner_ex = (int)(_style.round_corner_ex * scale);
-    _style.shadow_radius = (int)(_style.shadow_radius * scale);
-    _style.shadow_offset_x = (int)(_style.shadow_offset_x * scale);
-    _style.shadow_offset_y = (int)(_style.shadow_offset_y * scale);
-  }
+      candidates_count((int)candidates.size()) {
+  _SetStyle(style, pDWR ? pDWR->dpiScaleLayout : 1.0f);
+}
+
+void Layout::Rebind(const UIStyle& style, PDWR pDWR) {
+  float scale = pDWR ? pDWR->dpiScaleLayout : 1.0f;
+  if (scale != _scale || _baseStyle != style)
+    _SetStyle(style, scale);
+  candidates_count = (int)candidates.size();
+  mark_width = 4;
+  mark_gap = 8;
+  mark_height = 0;
+  _textLayouts.clear();
+}
+
+void Layout::_SetStyle(const UIStyle& style, float scale) {
+  _baseStyle = style;
+  _scale = scale;
+  _style = style;
+  labelFontValid = !!(_style.label_font_point > 0);
+  textFontValid = !!(_style.font_point > 0);
+  cmtFontValid = !!(_style.comment_font_point > 0);
+  _style.min_width = (int)(_style.min_width * scale);
+  _style.min_height = (int)(_style.min_height * scale);
+  _style.max_width = (int)(_style.max_width * scale);
+  _style.max_height = (int)(_style.max_height * scale);
+  _style.border = (int)(_style.border * scale);
+  _style.margin_x = (int)(_style.margin_x * scale);
+  _style.margin_y = (int)(_style.margin_y * scale);
+  _style.spacing = (int)(_style.spacing * scale);
+  _style.candidate_spacing = (int)(_style.candidate_spacing * scale);
+  _style.hilite_spacing = (int)(_style.hilite_spacing * scale);
+  _style.hilite_padding_x = (int)(_style.hilite_padding_x * scale);
+  _style.hilite_padding_y = (int)(_style.hilite_padding_y * scale);
+  _style.round_corner = (int)(_style.round_corner * scale);
+  _style.round_corner_ex = (int)(_style.round_corner_ex * scale);
+  _style.shadow_radius = (int)(_style.shadow_radius * scale);
+  _style.shadow_offset_x = (int)(_style.shadow_offset_x * scale);
+  _style.shadow_offset_y = (int)(_style.shadow_offset_y * scale);
   real_margin_x = ((abs(_style.margin_x) > _style.hilite_padding_x)
                        ? abs(_style.margin_x)
                        : _style.hilite_padding_x);
@@ -56,6 +70,40 @@ Layout::Layout(const UIStyle& style,
   offsetY += _style.border * 2;
 }
 
+ComPtr<IDWriteTextLayout2> Layout::GetTextLayout(
+    const std::wstring& text,
+    size_t nCount,
+    IDWriteTextFormat1* pTextFormat,
+    PDWR pDWR) const {
+  ComPtr<IDWriteTextLayout2> pTextLayout;
+  if (pTextFormat == NULL || pDWR == NULL || pDWR->pDWFactory == NULL)
+    return pTextLayout;
+  TextLayoutKey key(text.substr(0, nCount), pTextFormat);
+  auto it = _textLayouts.find(key);
+  if (it != _textLayouts.end())
+    return it->second.layout;
+  // labels and the mark look the same in every frame, shape them only once
+  // for all layouts
+  if (pTextFormat == pDWR->pLabelTextFormat.Get() ||
+      (!_style.mark_text.empty() && key.first == _style.mark_text)) {
+    pTextLayout = pDWR->GetStaticTextLayout(key.first, pTextFormat);
+    if (pTextLayout == NULL)
+      return pTextLayout;
+  } else {
+    // max width / height are set by the caller before each use
+    HRESULT hr = pDWR->pDWFactory->CreateTextLayout(
+        key.first.c_str(), (UINT32)key.first.length(), pTextFormat, 0.0f,
+        0.0f,
+        reinterpret_cast<IDWriteTextLayout**>(pTextLayout.GetAddressOf()));
+    if (FAILED(hr))
+      return ComPtr<IDWriteTextLayout2>();
+  }
+  TextLayoutEntry& entry = _textLayouts[key];
+  entry.format = pTextFormat;
+  entry.layout = pTextLayout;
+  return pTextLayout;
+}
+
 GraphicsRoundRectPath::GraphicsRoundRectPath(const CRect rc,
                                              int corner,
                                              bool roundTopLeft,
@@ -3,6 +3,8 @@
 #include <WeaselIPCData.h>
 #include <WeaselUI.h>
 #include <gdiplus.h>
+#include "TextMeasurer.h"
+#include <map>
 
 #pragma comment(lib, "gdiplus.lib")
 #define IS_FULLSCREENLAYOUT(style)                             \
@@ -68,8 +70,17 @@ class Layout {
          const Context& context,
          const Status& status,
          PDWR pDWR);
+  virtual ~Layout() {}
 
+  /* Reuse this layout for the next frame of the same context and status,
+   * scaled metrics are recomputed only if style or dpi changed */
+  virtual void Rebind(const UIStyle& style, PDWR pDWR);
   virtual void DoLayout(CDCHandle dc, PDWR pDWR = NULL) = 0;
+  /* Update highlight rects after only the highlighted index changed,
+   * returns false if a full DoLayout is needed */
+  virtual bool UpdateHighlight() { return false; }
+  /* Measure text with another backend, NULL for the default one */
+  virtual void SetTextMeasurer(TextMeasurer* measurer) {}
   /* All points in this class is based on the content area */
   /* The top-left corner of the content area is always (0, 0) */
   virtual CSize GetContentSize() const = 0;
@@ -101,6 +112,12 @@ class Layout {
                              ComPtr<IDWriteTextFormat1> pTextFormat,
                              PDWR pDWR,
                              LPSIZE lpSize) const = 0;
+  /* text layouts shaped in this frame, shared by measuring and drawing */
+  virtual ComPtr<IDWriteTextLayout2> GetTextLayout(
+      const std::wstring& text,
+      size_t nCount,
+      IDWriteTextFormat1* pTextFormat,
+      PDWR pDWR) const;
 
   int offsetX = 0;
   int offsetY = 0;
@@ -118,9 +135,23 @@ class Layout {
   const std::vector<Text>& comments;
   const std::vector<Text>& labels;
   const int& id;
-  const int candidates_count;
-  const int labelFontValid;
-  const int textFontValid;
-  const int cmtFontValid;
+  int candidates_count;
+  int labelFontValid;
+  int textFontValid;
+  int cmtFontValid;
+
+ private:
+  void _SetStyle(const UIStyle& style, float scale);
+
+  // unscaled style and scale _style was computed from
+  UIStyle _baseStyle;
+  float _scale;
+  struct TextLayoutEntry {
+    // keep the format alive so its address is not reused as a key
+    ComPtr<IDWriteTextFormat1> format;
+    ComPtr<IDWriteTextLayout2> layout;
+  };
+  typedef std::pair<std::wstring, IDWriteTextFormat1*> TextLayoutKey;
+  mutable std::map<TextLayoutKey, TextLayoutEntry> _textLayouts;
 };
 };  // namespace weasel
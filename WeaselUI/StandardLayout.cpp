@@ -1,14 +1,69 @@
 #include "stdafx.h"
 #include "StandardLayout.h"
+#include <climits>
+#include <vector>
 
 using namespace weasel;
 
+void StandardLayout::Rebind(const UIStyle& style, PDWR pDWR) {
+  // only the rects of the last candidates were written, clear those
+  int used = min(candidates_count, MAX_CANDIDATES_COUNT);
+  Layout::Rebind(style, pDWR);
+  _dwMeasurer.SetResources(pDWR);
+  for (int i = 0; i < used; ++i) {
+    _candidateRects[i].SetRectEmpty();
+    _candidateLabelRects[i].SetRectEmpty();
+    _candidateTextRects[i].SetRectEmpty();
+    _candidateCommentRects[i].SetRectEmpty();
+    _roundInfo[i] = IsToRoundStruct();
+  }
+  _beforesz = _hilitedsz = _aftersz = CSize();
+  _range = weasel::TextRange();
+  _contentSize = CSize();
+  _preeditRect = _auxiliaryRect = _highlightRect = CRect();
+  _statusIconRect = _bgRect = _contentRect = CRect();
+  _prePageRect = _nextPageRect = CRect();
+  _textRoundInfo = IsToRoundStruct();
+}
+
 std::wstring StandardLayout::GetLabelText(const std::vector<Text>& labels,
                                           int id,
                                           const wchar_t* format) const {
-  wchar_t buffer[128];
-  swprintf_s<128>(buffer, format, labels.at(id).str.c_str());
-  return std::wstring(buffer);
+  // label_text_format is "%s." and alike, fill it in without printf
+  const std::wstring& label = labels.at(id).str;
+  std::wstring text;
+  bool filled = false;
+  for (const wchar_t* p = format; *p; ++p) {
+    if (*p != L'%') {
+      text.push_back(*p);
+    } else if (p[1] == L'%') {
+      text.push_back(L'%');
+      ++p;
+    } else if (p[1] == L's' && !filled) {
+      text.append(label);
+      filled = true;
+      ++p;
+    } else {
+      wchar_t buffer[128];
+      swprintf_s<128>(buffer, format, label.c_str());
+      return std::wstring(buffer);
+    }
+  }
+  return text;
+}
+
+void DirectWriteTextMeasurer::MeasureText(const std::wstring& text,
+                                          size_t nCount,
+                                          TextFontType font,
+                                          int& cx,
+                                          int& cy) {
+  ComPtr<IDWriteTextFormat1> formats[] = {
+      _pDWR->pLabelTextFormat, _pDWR->pTextFormat, _pDWR->pCommentTextFormat,
+      _pDWR->pPreeditTextFormat};
+  SIZE size;
+  _layout.GetTextSizeDW(text, nCount, formats[font], _pDWR, &size);
+  cx = size.cx;
+  cy = size.cy;
 }
 
 void weasel::StandardLayout::GetTextSizeDW(
@@ -25,72 +80,92 @@ void weasel::StandardLayout::GetTextSizeDW(
     lpSize->cy = 0;
     return;
   }
-  // 创建文本布局
-  if (pTextFormat != NULL) {
-    if (_style.layout_type == UIStyle::LAYOUT_VERTICAL_TEXT)
-      hr = pDWR->CreateTextLayout(text.c_str(), (int)nCount, pTextFormat.Get(),
-                                  0.0f, (float)_style.max_height);
-    else
-      hr = pDWR->CreateTextLayout(text.c_str(), (int)nCount, pTextFormat.Get(),
-                                  (float)_style.max_width, 0);
+  TextSizeKey key{text.substr(0, nCount),
+                  pTextFormat.Get(),
+                  _style.max_width,
+                  _style.max_height,
+                  _style.layout_type == UIStyle::LAYOUT_VERTICAL_TEXT,
+                  _style.vertical_text_left_to_right};
+  if (pDWR->FindTextSize(key, lpSize))
+    return;
+  // 创建文本布局, 绘制时复用
+  ComPtr<IDWriteTextLayout2> pTextLayout =
+      GetTextLayout(text, nCount, pTextFormat.Get(), pDWR);
+  if (pTextLayout == NULL) {
+    lpSize->cx = 0;
+    lpSize->cy = 0;
+    return;
+  }
+  bool vertical = _style.layout_type == UIStyle::LAYOUT_VERTICAL_TEXT;
+  if (vertical) {
+    DWRITE_FLOW_DIRECTION flow = _style.vertical_text_left_to_right
+                                     ? DWRITE_FLOW_DIRECTION_LEFT_TO_RIGHT
+                                     : DWRITE_FLOW_DIRECTION_RIGHT_TO_LEFT;
+    pTextLayout->SetMaxWidth(0.0f);
+    pTextLayout->SetMaxHeight((float)_style.max_height);
+    pTextLayout->SetReadingDirection(DWRITE_READING_DIRECTION_TOP_TO_BOTTOM);
+    pTextLayout->SetFlowDirection(flow);
+  } else {
+    pTextLayout->SetMaxWidth((float)_style.max_width);
+    pTextLayout->SetMaxHeight(0.0f);
+  }
+  // 获取文本尺寸
+  DWRITE_TEXT_METRICS textMetrics;
+  hr = pTextLayout->GetMetrics(&textMetrics);
+  if (FAILED(hr)) {
+    lpSize->cx = 0;
+    lpSize->cy = 0;
+    return;
   }
+  sz = D2D1::SizeF(ceil(textMetrics.widthIncludingTrailingWhitespace),
+                   ceil(textMetrics.height));
+  lpSize->cx = (int)sz.width;
+  lpSize->cy = (int)sz.height;
 
+  if (!vertical) {
+    auto max_width = _style.max_width == 0
+                         ? textMetrics.widthIncludingTrailingWhitespace
+                         : _style.max_width;
+    pTextLayout->SetMaxWidth(max_width);
+    pTextLayout->SetMaxHeight(textMetrics.height);
+  } else {
+    auto max_height =
+        _style.max_height == 0 ? textMetrics.height : _style.max_height;
+    pTextLayout->SetMaxWidth(textMetrics.widthIncludingTrailingWhitespace);
+    pTextLayout->SetMaxHeight(max_height);
+    pTextLayout->SetFlowDirection(DWRITE_FLOW_DIRECTION_RIGHT_TO_LEFT);
+  }
+  DWRITE_OVERHANG_METRICS overhangMetrics;
+  hr = pTextLayout->GetOverhangMetrics(&overhangMetrics);
   if (SUCCEEDED(hr)) {
-    if (_style.layout_type == UIStyle::LAYOUT_VERTICAL_TEXT) {
-      DWRITE_FLOW_DIRECTION flow = _style.vertical_text_left_to_right
-                                       ? DWRITE_FLOW_DIRECTION_LEFT_TO_RIGHT
-                                       : DWRITE_FLOW_DIRECTION_RIGHT_TO_LEFT;
-      pDWR->SetLayoutReadingDirection(DWRITE_READING_DIRECTION_TOP_TO_BOTTOM);
-      pDWR->SetLayoutFlowDirection(flow);
-    }
-    // 获取文本尺寸
-    DWRITE_TEXT_METRICS textMetrics;
-    hr = pDWR->GetLayoutMetrics(&textMetrics);
-    sz = D2D1::SizeF(ceil(textMetrics.widthIncludingTrailingWhitespace),
-                     ceil(textMetrics.height));
-
-    lpSize->cx = (int)sz.width;
-    lpSize->cy = (int)sz.height;
-    pDWR->ResetLayout();
-
-    if (_style.layout_type != UIStyle::LAYOUT_VERTICAL_TEXT) {
-      auto max_width = _style.max_width == 0
-                           ? textMetrics.widthIncludingTrailingWhitespace
-                           : _style.max_width;
-      hr = pDWR->CreateTextLayout(text.c_str(), (int)nCount, pTextFormat.Get(),
-                                  max_width, textMetrics.height);
-    } else {
-      auto max_height =
-          _style.max_height == 0 ? textMetrics.height : _style.max_height;
-      hr = pDWR->CreateTextLayout(text.c_str(), (int)nCount, pTextFormat.Get(),
-                                  textMetrics.widthIncludingTrailingWhitespace,
-                                  max_height);
-    }
-
-    if (_style.layout_type == UIStyle::LAYOUT_VERTICAL_TEXT) {
-      pDWR->SetLayoutReadingDirection(DWRITE_READING_DIRECTION_TOP_TO_BOTTOM);
-      pDWR->SetLayoutFlowDirection(DWRITE_FLOW_DIRECTION_RIGHT_TO_LEFT);
-    }
-    DWRITE_OVERHANG_METRICS overhangMetrics;
-    hr = pDWR->GetLayoutOverhangMetrics(&overhangMetrics);
-    {
-      if (overhangMetrics.left > 0)
-        lpSize->cx += (LONG)(overhangMetrics.left + 1);
-      if (overhangMetrics.right > 0)
-        lpSize->cx += (LONG)(overhangMetrics.right + 1);
-      if (overhangMetrics.top > 0)
-        lpSize->cy += (LONG)(overhangMetrics.top + 1);
-      if (overhangMetrics.bottom > 0)
-        lpSize->cy += (LONG)(overhangMetrics.bottom + 1);
-    }
+    if (overhangMetrics.left > 0)
+      lpSize->cx += (LONG)(overhangMetrics.left + 1);
+    if (overhangMetrics.right > 0)
+      lpSize->cx += (LONG)(overhangMetrics.right + 1);
+    if (overhangMetrics.top > 0)
+      lpSize->cy += (LONG)(overhangMetrics.top + 1);
+    if (overhangMetrics.bottom > 0)
+      lpSize->cy += (LONG)(overhangMetrics.bottom + 1);
+    pDWR->CacheTextSize(key, *lpSize);
   }
-  pDWR->ResetLayout();
+}
+
+// candidate geometry depends on the highlighted index only through the
+// visibility of its comment, unless a subclass shifts it by the mark
+bool StandardLayout::UpdateHighlight() {
+  if (id < 0 || id >= candidates_count || id >= MAX_CANDIDATES_COUNT)
+    return false;
+  bool hilitedCmtVisible = !!(_style.hilited_comment_text_color & 0xff000000);
+  bool cmtVisible = !!(_style.comment_text_color & 0xff000000);
+  if (cmtFontValid && hilitedCmtVisible != cmtVisible)
+    return false;
+  _highlightRect = _candidateRects[id];
+  return true;
 }
 
 CSize StandardLayout::GetPreeditSize(CDCHandle dc,
                                      const weasel::Text& text,
-                                     ComPtr<IDWriteTextFormat1> pTextFormat,
-                                     PDWR pDWR) {
+                                     TextFontType font) {
   const std::wstring& preedit = text.str;
   const std::vector<weasel::TextAttribute>& attrs = text.attributes;
   CSize size(0, 0);
@@ -103,12 +178,9 @@ CSize StandardLayout::GetPreeditSize(CDCHandle dc,
       std::wstring before_str = preedit.substr(0, _range.start);
       std::wstring hilited_str = preedit.substr(_range.start, _range.end);
       std::wstring after_str = preedit.substr(_range.end);
-      GetTextSizeDW(before_str, before_str.length(), pTextFormat, pDWR,
-                    &_beforesz);
-      GetTextSizeDW(hilited_str, hilited_str.length(), pTextFormat, pDWR,
-                    &_hilitedsz);
-      GetTextSizeDW(after_str, after_str.length(), pTextFormat, pDWR,
-                    &_aftersz);
+      GetTextSize(before_str, before_str.length(), font, &_beforesz);
+      GetTextSize(hilited_str, hilited_str.length(), font, &_hilitedsz);
+      GetTextSize(after_str, after_str.length(), font, &_aftersz);
       auto width_max = 0, height_max = 0;
       if (_style.layout_type == UIStyle::LAYOUT_VERTICAL_TEXT) {
         width_max = max(width_max, _beforesz.cx);
@@ -130,7 +202,7 @@ CSize StandardLayout::GetPreeditSize(CDCHandle dc,
       size.cx = width_max;
       size.cy = height_max;
     } else
-      GetTextSizeDW(preedit, preedit.length(), pTextFormat, pDWR, &size);
+      GetTextSize(preedit, preedit.length(), font, &size);
   }
   return size;
 }
@@ -155,6 +227,63 @@ bool weasel::StandardLayout::_IsHighlightOverCandidateWindow(CRect& rc,
   return res;
 }
 
+int StandardLayout::_BreakLines(const int* extents,
+                                int count,
+                                int gap,
+                                int limit,
+                                int* line_of) const {
+  // greedy, a candidate starts a new line when it does not fit in the last
+  int lines = 0, end = 0;
+  for (int i = 0; i < count; ++i) {
+    if (i > 0 && end + gap + extents[i] > limit) {
+      ++lines;
+      end = extents[i];
+    } else {
+      end = (i > 0 ? end + gap : 0) + extents[i];
+    }
+    line_of[i] = lines;
+  }
+  ++lines;
+  if (!_style.balanced_wrap || lines < 2)
+    return lines;
+
+  // balanced, keep the number of lines and minimize the sum of squared line
+  // lengths, so that the lines come out as even as possible
+  std::vector<int> prefix(count + 1, 0);
+  for (int i = 0; i < count; ++i)
+    prefix[i + 1] = prefix[i] + extents[i];
+  const int n = count + 1;
+  std::vector<long long> cost(n * (lines + 1), LLONG_MAX);
+  std::vector<int> from(n * (lines + 1), 0);
+  cost[0] = 0;
+  for (int j = 1; j <= lines; ++j) {
+    for (int b = j; b <= count; ++b) {
+      // candidates [a, b) in line j
+      for (int a = b - 1; a >= j - 1; --a) {
+        long long len = prefix[b] - prefix[a] + (long long)(b - a - 1) * gap;
+        if (len > limit && b - a > 1)
+          break;
+        long long prev = cost[(j - 1) * n + a];
+        if (prev == LLONG_MAX)
+          continue;
+        if (prev + len * len < cost[j * n + b]) {
+          cost[j * n + b] = prev + len * len;
+          from[j * n + b] = a;
+        }
+      }
+    }
+  }
+  if (cost[lines * n + count] == LLONG_MAX)
+    return lines;
+  for (int j = lines, b = count; j > 0; --j) {
+    int a = from[j * n + b];
+    for (int i = a; i < b; ++i)
+      line_of[i] = j - 1;
+    b = a;
+  }
+  return lines;
+}
+
 // prepare Hemispherical rounding info
 void weasel::StandardLayout::_PrepareRoundInfo(CDCHandle& dc) {
   const int tmp[5] = {UIStyle::LAYOUT_VERTICAL, UIStyle::LAYOUT_HORIZONTAL,
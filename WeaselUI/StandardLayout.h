@@ -10,16 +10,37 @@ namespace weasel {
 const int MAX_CANDIDATES_COUNT = 100;
 const int STATUS_ICON_SIZE = GetSystemMetrics(SM_CXICON);
 
+class StandardLayout;
+// measures with the DirectWrite text formats of pDWR
+class DirectWriteTextMeasurer : public TextMeasurer {
+ public:
+  DirectWriteTextMeasurer(const StandardLayout& layout, PDWR pDWR)
+      : _layout(layout), _pDWR(pDWR) {}
+  virtual void MeasureText(const std::wstring& text,
+                           size_t nCount,
+                           TextFontType font,
+                           int& cx,
+                           int& cy);
+  void SetResources(PDWR pDWR) { _pDWR = pDWR; }
+
+ private:
+  const StandardLayout& _layout;
+  PDWR _pDWR;
+};
+
 class StandardLayout : public Layout {
  public:
   StandardLayout(const UIStyle& style,
                  const Context& context,
                  const Status& status,
                  PDWR pDWR)
-      : Layout(style, context, status, pDWR) {}
+      : Layout(style, context, status, pDWR),
+        _dwMeasurer(*this, pDWR),
+        _measurer(&_dwMeasurer) {}
 
   /* Layout */
 
+  virtual void Rebind(const UIStyle& style, PDWR pDWR);
   virtual void DoLayout(CDCHandle dc, PDWR pDWR = NULL) = 0;
   virtual CSize GetContentSize() const { return _contentSize; }
   virtual CRect GetPreeditRect() const { return _preeditRect; }
@@ -51,6 +72,12 @@ class StandardLayout : public Layout {
   virtual CSize GetAfterSize() { return _aftersz; }
   virtual weasel::TextRange GetPreeditRange() { return _range; }
 
+  virtual bool UpdateHighlight();
+  // NULL restores the DirectWrite measurer
+  virtual void SetTextMeasurer(TextMeasurer* measurer) {
+    _measurer = measurer ? measurer : &_dwMeasurer;
+  }
+
   void GetTextSizeDW(const std::wstring text,
                      size_t nCount,
                      ComPtr<IDWriteTextFormat1> pTextFormat,
@@ -59,11 +86,23 @@ class StandardLayout : public Layout {
 
  protected:
   /* Utility functions */
+  void GetTextSize(const std::wstring& text,
+                   size_t nCount,
+                   TextFontType font,
+                   LPSIZE lpSize) const {
+    int cx = 0, cy = 0;
+    _measurer->MeasureText(text, nCount, font, cx, cy);
+    lpSize->cx = cx;
+    lpSize->cy = cy;
+  }
   CSize GetPreeditSize(CDCHandle dc,
                        const weasel::Text& text,
-                       ComPtr<IDWriteTextFormat1> pTextFormat = NULL,
-                       PDWR pDWR = NULL);
+                       TextFontType font = PREEDIT_FONT);
   bool _IsHighlightOverCandidateWindow(CRect& rc, CDCHandle& dc);
+  /* Break candidates of the given extents, gap apart, into lines no longer
+   * than limit. Fills line_of and returns the number of lines */
+  int _BreakLines(const int* extents, int count, int gap, int limit,
+                  int* line_of) const;
   void _PrepareRoundInfo(CDCHandle& dc);
 
   void UpdateStatusIconLayout(int* width, int* height);
@@ -85,5 +124,9 @@ class StandardLayout : public Layout {
   CRect _nextPageRect;
   const std::wstring pre = L"<";
   const std::wstring next = L">";
+
+ private:
+  DirectWriteTextMeasurer _dwMeasurer;
+  TextMeasurer* _measurer;
 };
 };  // namespace weasel
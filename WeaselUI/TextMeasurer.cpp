@@ -0,0 +1,36 @@
+#include "stdafx.h"
+#include "TextMeasurer.h"
+#include <algorithm>
+
+using namespace weasel;
+
+static bool is_high_surrogate(wchar_t ch) {
+  return ch >= 0xd800 && ch <= 0xdbff;
+}
+
+static bool is_low_surrogate(wchar_t ch) {
+  return ch >= 0xdc00 && ch <= 0xdfff;
+}
+
+void FakeTextMeasurer::MeasureText(const std::wstring& text,
+                                   size_t nCount,
+                                   TextFontType font,
+                                   int& cx,
+                                   int& cy) {
+  const int em = _ems[font];
+  nCount = (std::min)(nCount, text.length());
+  int advance = 0;
+  for (size_t i = 0; i < nCount; ++i) {
+    wchar_t ch = text[i];
+    if (is_high_surrogate(ch) && i + 1 < nCount &&
+        is_low_surrogate(text[i + 1])) {
+      advance += em;
+      ++i;
+    } else {
+      advance += ch < 0x80 ? em / 2 : em;
+    }
+  }
+  int line = em + em / 4;
+  cx = _vertical ? line : advance;
+  cy = _vertical ? advance : line;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <string>
+
+namespace weasel {
+// the font a piece of panel text is set in
+enum TextFontType { LABEL_FONT, TEXT_FONT, COMMENT_FONT, PREEDIT_FONT };
+
+// text metrics used by the layouts, so their geometry does not depend on a
+// particular text engine; free of platform types, a port only replaces the
+// backend
+class TextMeasurer {
+ public:
+  virtual ~TextMeasurer() {}
+  /* size of the first nCount characters of text, glyph overhangs included */
+  virtual void MeasureText(const std::wstring& text,
+                           size_t nCount,
+                           TextFontType font,
+                           int& cx,
+                           int& cy) = 0;
+};
+
+// deterministic metrics for tests and benchmarks: ascii advances half an em,
+// any other code point (a surrogate pair counts once) a full em, and a line
+// is 1.25 em high; in vertical text the two axes are swapped
+class FakeTextMeasurer : public TextMeasurer {
+ public:
+  FakeTextMeasurer(int label_em,
+                   int text_em,
+                   int comment_em,
+                   int preedit_em,
+                   bool vertical = false)
+      : _ems{label_em, text_em, comment_em, preedit_em}, _vertical(vertical) {}
+  virtual void MeasureText(const std::wstring& text,
+                           size_t nCount,
+                           TextFontType font,
+                           int& cx,
+                           int& cy);
+
+ private:
+  int _ems[4];
+  bool _vertical;
+};
+};  // namespace weasel
@@ -1,6 +1,7 @@
 
 #include "stdafx.h"
 #include "VHorizontalLayout.h"
+#include <climits>
 
 using namespace weasel;
 
@@ -18,10 +19,10 @@ void VHorizontalLayout::DoLayout(CDCHandle dc, PDWR pDWR) {
     CSize sg;
     if (candidates_count) {
       if (_style.mark_text.empty())
-        GetTextSizeDW(L"|", 1, pDWR->pTextFormat, pDWR, &sg);
+        GetTextSize(L"|", 1, TEXT_FONT, &sg);
       else
-        GetTextSizeDW(_style.mark_text, _style.mark_text.length(),
-                      pDWR->pTextFormat, pDWR, &sg);
+        GetTextSize(_style.mark_text, _style.mark_text.length(), TEXT_FONT,
+                    &sg);
     }
 
     mark_width = sg.cx;
@@ -41,8 +42,8 @@ void VHorizontalLayout::DoLayout(CDCHandle dc, PDWR pDWR) {
   // calc page indicator
   CSize pgszl, pgszr;
   if (!IsInlinePreedit()) {
-    GetTextSizeDW(pre, pre.length(), pDWR->pPreeditTextFormat, pDWR, &pgszl);
-    GetTextSizeDW(next, next.length(), pDWR->pPreeditTextFormat, pDWR, &pgszr);
+    GetTextSize(pre, pre.length(), PREEDIT_FONT, &pgszl);
+    GetTextSize(next, next.length(), PREEDIT_FONT, &pgszr);
   }
   bool page_en = (_style.prevpage_color & 0xff000000) &&
                  (_style.nextpage_color & 0xff000000);
@@ -53,7 +54,7 @@ void VHorizontalLayout::DoLayout(CDCHandle dc, PDWR pDWR) {
 
   /* Preedit */
   if (!IsInlinePreedit() && !_context.preedit.str.empty()) {
-    size = GetPreeditSize(dc, _context.preedit, pDWR->pPreeditTextFormat, pDWR);
+    size = GetPreeditSize(dc, _context.preedit, PREEDIT_FONT);
     int szx = max(size.cx, pgw), szy = pgh;
     // icon size wider then preedit text
     int xoffset = (STATUS_ICON_SIZE >= szx && ShouldDisplayStatusIcon())
@@ -69,7 +70,7 @@ void VHorizontalLayout::DoLayout(CDCHandle dc, PDWR pDWR) {
 
   /* Auxiliary */
   if (!_context.aux.str.empty()) {
-    size = GetPreeditSize(dc, _context.aux, pDWR->pPreeditTextFormat, pDWR);
+    size = GetPreeditSize(dc, _context.aux, PREEDIT_FONT);
     // icon size wider then preedit text
     int xoffset = (STATUS_ICON_SIZE >= size.cx && ShouldDisplayStatusIcon())
                       ? (STATUS_ICON_SIZE - size.cx) / 2
@@ -90,7 +91,7 @@ void VHorizontalLayout::DoLayout(CDCHandle dc, PDWR pDWR) {
       /* Label */
       std::wstring label =
           GetLabelText(labels, i, _style.label_text_format.c_str());
-      GetTextSizeDW(label, label.length(), pDWR->pLabelTextFormat, pDWR, &size);
+      GetTextSize(label, label.length(), LABEL_FONT, &size);
       _candidateLabelRects[i].SetRect(w, h, w + size.cx * labelFontValid,
                                       h + size.cy);
       h += size.cy * labelFontValid;
@@ -100,7 +101,7 @@ void VHorizontalLayout::DoLayout(CDCHandle dc, PDWR pDWR) {
       /* Text */
       h += _style.hilite_spacing * labelFontValid;
       const std::wstring& text = candidates.at(i).str;
-      GetTextSizeDW(text, text.length(), pDWR->pTextFormat, pDWR, &size);
+      GetTextSize(text, text.length(), TEXT_FONT, &size);
       _candidateTextRects[i].SetRect(w, h, w + size.cx * textFontValid,
                                      h + size.cy);
       h += size.cy * textFontValid;
@@ -114,8 +115,7 @@ void VHorizontalLayout::DoLayout(CDCHandle dc, PDWR pDWR) {
       if (!comments.at(i).str.empty() && cmtFontValid && cmtFontNotTrans) {
         h += _style.hilite_spacing;
         const std::wstring& comment = comments.at(i).str;
-        GetTextSizeDW(comment, comment.length(), pDWR->pCommentTextFormat, pDWR,
-                      &size);
+        GetTextSize(comment, comment.length(), COMMENT_FONT, &size);
         _candidateCommentRects[i].SetRect(w, 0, w + size.cx * cmtFontValid,
                                           size.cy * cmtFontValid);
         h += size.cy * cmtFontValid;
@@ -264,10 +264,10 @@ void VHorizontalLayout::DoLayoutWithWrap(CDCHandle dc, PDWR pDWR) {
     CSize sg;
     if (candidates_count) {
       if (_style.mark_text.empty())
-        GetTextSizeDW(L"|", 1, pDWR->pTextFormat, pDWR, &sg);
+        GetTextSize(L"|", 1, TEXT_FONT, &sg);
       else
-        GetTextSizeDW(_style.mark_text, _style.mark_text.length(),
-                      pDWR->pTextFormat, pDWR, &sg);
+        GetTextSize(_style.mark_text, _style.mark_text.length(), TEXT_FONT,
+                    &sg);
     }
 
     mark_width = sg.cx;
@@ -287,8 +287,8 @@ void VHorizontalLayout::DoLayoutWithWrap(CDCHandle dc, PDWR pDWR) {
   // calc page indicator
   CSize pgszl, pgszr;
   if (!IsInlinePreedit()) {
-    GetTextSizeDW(pre, pre.length(), pDWR->pPreeditTextFormat, pDWR, &pgszl);
-    GetTextSizeDW(next, next.length(), pDWR->pPreeditTextFormat, pDWR, &pgszr);
+    GetTextSize(pre, pre.length(), PREEDIT_FONT, &pgszl);
+    GetTextSize(next, next.length(), PREEDIT_FONT, &pgszr);
   }
   bool page_en = (_style.prevpage_color & 0xff000000) &&
                  (_style.nextpage_color & 0xff000000);
@@ -299,7 +299,7 @@ void VHorizontalLayout::DoLayoutWithWrap(CDCHandle dc, PDWR pDWR) {
 
   /* Preedit */
   if (!IsInlinePreedit() && !_context.preedit.str.empty()) {
-    size = GetPreeditSize(dc, _context.preedit, pDWR->pPreeditTextFormat, pDWR);
+    size = GetPreeditSize(dc, _context.preedit, PREEDIT_FONT);
     size_t szx = max(size.cx, pgw), szy = pgh;
     // icon size wider then preedit text
     int xoffset = ((size_t)STATUS_ICON_SIZE >= szx && ShouldDisplayStatusIcon())
@@ -315,7 +315,7 @@ void VHorizontalLayout::DoLayoutWithWrap(CDCHandle dc, PDWR pDWR) {
   }
   /* Auxiliary */
   if (!_context.aux.str.empty()) {
-    size = GetPreeditSize(dc, _context.aux, pDWR->pPreeditTextFormat, pDWR);
+    size = GetPreeditSize(dc, _context.aux, PREEDIT_FONT);
     // icon size wider then auxiliary text
     int xoffset = (STATUS_ICON_SIZE >= size.cx && ShouldDisplayStatusIcon())
                       ? (STATUS_ICON_SIZE - size.cx) / 2
@@ -331,31 +331,31 @@ void VHorizontalLayout::DoLayoutWithWrap(CDCHandle dc, PDWR pDWR) {
   int width_of_cols[MAX_CANDIDATES_COUNT] = {0};
   int col_of_candidate[MAX_CANDIDATES_COUNT] = {0};
   int minleft_of_cols[MAX_CANDIDATES_COUNT] = {0};
+  int first_cand_of_cols[MAX_CANDIDATES_COUNT] = {0};
   if (candidates_count) {
-    h = offsetY + real_margin_y;
-    for (auto i = 0; i < candidates_count && i < MAX_CANDIDATES_COUNT; i++) {
-      int current_cand_height = 0;
-      if (i > 0)
-        h += _style.candidate_spacing;
+    const int count = min(candidates_count, MAX_CANDIDATES_COUNT);
+    const int left = width, top = offsetY + real_margin_y;
+    int height_of_candidate[MAX_CANDIDATES_COUNT] = {0};
+    // measure every candidate once, as if it started the first column
+    for (auto i = 0; i < count; i++) {
+      h = top;
       if (id == i)
         h += base_offset;
       /* Label */
       std::wstring label =
           GetLabelText(labels, i, _style.label_text_format.c_str());
-      GetTextSizeDW(label, label.length(), pDWR->pLabelTextFormat, pDWR, &size);
+      GetTextSize(label, label.length(), LABEL_FONT, &size);
       _candidateLabelRects[i].SetRect(width, h, width + size.cx,
                                       h + size.cy * labelFontValid);
       h += size.cy * labelFontValid;
-      current_cand_height += size.cy * labelFontValid;
 
       /* Text */
       h += _style.hilite_spacing;
       const std::wstring& text = candidates.at(i).str;
-      GetTextSizeDW(text, text.length(), pDWR->pTextFormat, pDWR, &size);
+      GetTextSize(text, text.length(), TEXT_FONT, &size);
       _candidateTextRects[i].SetRect(width, h, width + size.cx,
                                      h + size.cy * textFontValid);
       h += size.cy * textFontValid;
-      current_cand_height += (size.cy + _style.hilite_spacing) * textFontValid;
 
       /* Comment */
       bool cmtFontNotTrans =
@@ -363,44 +363,47 @@ void VHorizontalLayout::DoLayoutWithWrap(CDCHandle dc, PDWR pDWR) {
           (i != id && (_style.comment_text_color & 0xff000000));
       if (!comments.at(i).str.empty() && cmtFontValid && cmtFontNotTrans) {
         const std::wstring& comment = comments.at(i).str;
-        GetTextSizeDW(comment, comment.length(), pDWR->pCommentTextFormat, pDWR,
-                      &size);
+        GetTextSize(comment, comment.length(), COMMENT_FONT, &size);
         h += _style.hilite_spacing;
         _candidateCommentRects[i].SetRect(width, h, width + size.cx,
                                           h + size.cy * cmtFontValid);
         h += size.cy * cmtFontValid;
-        current_cand_height += (size.cy + _style.hilite_spacing) * cmtFontValid;
       } else
         _candidateCommentRects[i].SetRect(width, h, width + size.cx, h);
-      int base_top = (i == id) ? _candidateLabelRects[i].top - base_offset
-                               : _candidateLabelRects[i].top;
-      if (_style.max_height > 0 && (base_top > real_margin_y + offsetY) &&
-          (_candidateCommentRects[i].bottom - offsetY + real_margin_y >
-           _style.max_height)) {
-        max_height_of_cols =
-            max(max_height_of_cols, _candidateCommentRects[i - 1].bottom);
-        h = offsetY + real_margin_y + (i == id ? base_offset : 0);
-        int ofy = h - _candidateLabelRects[i].top;
-        int ofx = width_of_cols[col_cnt] + _style.candidate_spacing;
-        _candidateLabelRects[i].OffsetRect(ofx, ofy);
-        _candidateTextRects[i].OffsetRect(ofx, ofy);
-        _candidateCommentRects[i].OffsetRect(ofx, ofy);
-        max_height_of_cols =
-            max(max_height_of_cols, _candidateCommentRects[i].bottom);
-        minleft_of_cols[col_cnt] = width;
-        width += ofx;
-        h += current_cand_height;
-        col_cnt++;
-      } else
-        max_height_of_cols = max(max_height_of_cols, h);
-      minleft_of_cols[col_cnt] = width;
-      width_of_cols[col_cnt] =
-          max(width_of_cols[col_cnt], _candidateLabelRects[i].Width());
-      width_of_cols[col_cnt] =
-          max(width_of_cols[col_cnt], _candidateTextRects[i].Width());
-      width_of_cols[col_cnt] =
-          max(width_of_cols[col_cnt], _candidateCommentRects[i].Width());
-      col_of_candidate[i] = col_cnt;
+      height_of_candidate[i] = _candidateCommentRects[i].bottom - top;
+    }
+
+    // break them into columns within max_height
+    int limit = _style.max_height > 0 ? _style.max_height - real_margin_y * 2
+                                      : INT_MAX;
+    col_cnt = _BreakLines(height_of_candidate, count, _style.candidate_spacing,
+                          limit, col_of_candidate) -
+              1;
+
+    // and move them to their columns
+    h = top;
+    for (auto i = 0; i < count; i++) {
+      int col = col_of_candidate[i];
+      if (i > 0 && col != col_of_candidate[i - 1]) {
+        width += width_of_cols[col - 1] + _style.candidate_spacing;
+        h = top;
+        first_cand_of_cols[col] = i;
+      } else if (i > 0)
+        h += _style.candidate_spacing;
+      int ofx = width - left, ofy = h - top;
+      _candidateLabelRects[i].OffsetRect(ofx, ofy);
+      _candidateTextRects[i].OffsetRect(ofx, ofy);
+      _candidateCommentRects[i].OffsetRect(ofx, ofy);
+      h += height_of_candidate[i];
+      max_height_of_cols =
+          max(max_height_of_cols, _candidateCommentRects[i].bottom);
+      minleft_of_cols[col] = width;
+      width_of_cols[col] =
+          max(width_of_cols[col], _candidateLabelRects[i].Width());
+      width_of_cols[col] =
+          max(width_of_cols[col], _candidateTextRects[i].Width());
+      width_of_cols[col] =
+          max(width_of_cols[col], _candidateCommentRects[i].Width());
     }
 
     for (auto i = 0; i < candidates_count && i < MAX_CANDIDATES_COUNT; ++i) {
@@ -452,7 +455,6 @@ void VHorizontalLayout::DoLayoutWithWrap(CDCHandle dc, PDWR pDWR) {
   } else
     width -= _style.spacing + offsetX;
   // reposition if not left to right
-  int first_cand_of_cols[MAX_CANDIDATES_COUNT] = {0};
   int offset_of_cols[MAX_CANDIDATES_COUNT] = {0};
   if (!_style.vertical_text_left_to_right) {
     // re position right to left
@@ -464,15 +466,7 @@ void VHorizontalLayout::DoLayoutWithWrap(CDCHandle dc, PDWR pDWR) {
     else if (candidates_count)
       base_left = _candidateRects[0].left;
     if (candidates_count) {
-      // calc offset for each col
-      for (auto col_t = 0; col_t <= col_cnt; col_t++) {
-        for (auto i = 0; i < candidates_count; i++) {
-          if (col_of_candidate[i] == col_t) {
-            first_cand_of_cols[col_t] = i;
-            break;
-          }
-        }
-      }
+      // calc offset for each col, from its first candidate
       for (auto i = col_cnt; i >= 0; i--) {
         int offset;
         if (i == col_cnt)
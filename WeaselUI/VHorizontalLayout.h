@@ -11,6 +11,13 @@ class VHorizontalLayout : public StandardLayout {
                     PDWR pDWR)
       : StandardLayout(style, context, status, pDWR) {}
   virtual void DoLayout(CDCHandle dc, PDWR pDWR = NULL);
+  virtual bool UpdateHighlight() {
+    // in wrap mode the mark above the highlighted candidate shifts the column
+    if (_style.vertical_text_with_wrap &&
+        (_style.hilited_mark_color & 0xff000000))
+      return false;
+    return StandardLayout::UpdateHighlight();
+  }
 
  private:
   void DoLayoutWithWrap(CDCHandle dc, PDWR pDWR = NULL);
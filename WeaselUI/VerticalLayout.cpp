@@ -11,10 +11,10 @@ void weasel::VerticalLayout::DoLayout(CDCHandle dc, PDWR pDWR) {
     CSize sg;
     if (candidates_count) {
       if (_style.mark_text.empty())
-        GetTextSizeDW(L"|", 1, pDWR->pTextFormat, pDWR, &sg);
+        GetTextSize(L"|", 1, TEXT_FONT, &sg);
       else
-        GetTextSizeDW(_style.mark_text, _style.mark_text.length(),
-                      pDWR->pTextFormat, pDWR, &sg);
+        GetTextSize(_style.mark_text, _style.mark_text.length(), TEXT_FONT,
+                    &sg);
     }
 
     mark_width = sg.cx;
@@ -34,8 +34,8 @@ void weasel::VerticalLayout::DoLayout(CDCHandle dc, PDWR pDWR) {
   // calc page indicator
   CSize pgszl, pgszr;
   if (!IsInlinePreedit()) {
-    GetTextSizeDW(pre, pre.length(), pDWR->pPreeditTextFormat, pDWR, &pgszl);
-    GetTextSizeDW(next, next.length(), pDWR->pPreeditTextFormat, pDWR, &pgszr);
+    GetTextSize(pre, pre.length(), PREEDIT_FONT, &pgszl);
+    GetTextSize(next, next.length(), PREEDIT_FONT, &pgszr);
   }
   bool page_en = (_style.prevpage_color & 0xff000000) &&
                  (_style.nextpage_color & 0xff000000);
@@ -48,7 +48,7 @@ void weasel::VerticalLayout::DoLayout(CDCHandle dc, PDWR pDWR) {
   CSize size;
   /* Preedit */
   if (!IsInlinePreedit() && !_context.preedit.str.empty()) {
-    size = GetPreeditSize(dc, _context.preedit, pDWR->pPreeditTextFormat, pDWR);
+    size = GetPreeditSize(dc, _context.preedit, PREEDIT_FONT);
     int szx = pgw, szy = max(size.cy, pgh);
     // icon size higher then preedit text
     int yoffset = (STATUS_ICON_SIZE >= szy && ShouldDisplayStatusIcon())
@@ -65,7 +65,7 @@ void weasel::VerticalLayout::DoLayout(CDCHandle dc, PDWR pDWR) {
 
   /* Auxiliary */
   if (!_context.aux.str.empty()) {
-    size = GetPreeditSize(dc, _context.aux, pDWR->pPreeditTextFormat, pDWR);
+    size = GetPreeditSize(dc, _context.aux, PREEDIT_FONT);
     // icon size higher then auxiliary text
     int yoffset = (STATUS_ICON_SIZE >= size.cy && ShouldDisplayStatusIcon())
                       ? (STATUS_ICON_SIZE - size.cy) / 2
@@ -91,7 +91,7 @@ void weasel::VerticalLayout::DoLayout(CDCHandle dc, PDWR pDWR) {
     /* Label */
     std::wstring label =
         GetLabelText(labels, i, _style.label_text_format.c_str());
-    GetTextSizeDW(label, label.length(), pDWR->pLabelTextFormat, pDWR, &size);
+    GetTextSize(label, label.length(), LABEL_FONT, &size);
     _candidateLabelRects[i].SetRect(w, height, w + size.cx * labelFontValid,
                                     height + size.cy);
     _candidateLabelRects[i].OffsetRect(offsetX, offsetY);
@@ -101,7 +101,7 @@ void weasel::VerticalLayout::DoLayout(CDCHandle dc, PDWR pDWR) {
 
     /* Text */
     const std::wstring& text = candidates.at(i).str;
-    GetTextSizeDW(text, text.length(), pDWR->pTextFormat, pDWR, &size);
+    GetTextSize(text, text.length(), TEXT_FONT, &size);
     _candidateTextRects[i].SetRect(w, height, w + size.cx * textFontValid,
                                    height + size.cy);
     _candidateTextRects[i].OffsetRect(offsetX, offsetY);
@@ -119,8 +119,7 @@ void weasel::VerticalLayout::DoLayout(CDCHandle dc, PDWR pDWR) {
       comment_shift_width = max(comment_shift_width, w);
 
       const std::wstring& comment = comments.at(i).str;
-      GetTextSizeDW(comment, comment.length(), pDWR->pCommentTextFormat, pDWR,
-                    &size);
+      GetTextSize(comment, comment.length(), COMMENT_FONT, &size);
       _candidateCommentRects[i].SetRect(0, height, size.cx * cmtFontValid,
                                         height + size.cy);
       _candidateCommentRects[i].OffsetRect(offsetX, offsetY);
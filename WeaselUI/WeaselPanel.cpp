@@ -1,6 +1,7 @@
 #include "stdafx.h"
 #include "WeaselPanel.h"
 
+#include <algorithm>
 #include <utility>
 #include <ShellScalingApi.h>
 #include <VersionHelpers.hpp>
@@ -24,18 +25,6 @@
 
 #pragma comment(lib, "Shcore.lib")
 
-template <class t0, class t1, class t2>
-inline void LoadIconNecessary(t0& a, t1& b, t2& c, int d) {
-  if (a == b)
-    return;
-  a = b;
-  if (b.empty())
-    c.LoadIconW(d, STATUS_ICON_SIZE, STATUS_ICON_SIZE, LR_DEFAULTCOLOR);
-  else
-    c = (HICON)LoadImage(NULL, b.c_str(), IMAGE_ICON, STATUS_ICON_SIZE,
-                         STATUS_ICON_SIZE, LR_LOADFROMFILE);
-}
-
 static inline void ReconfigRoundInfo(IsToRoundStruct& rd,
                                      const int& i,
                                      const int& m_candidateCount) {
@@ -54,34 +43,25 @@ WeaselPanel::WeaselPanel(weasel::UI& ui)
       m_ctx(ui.ctx()),
       m_octx(ui.octx()),
       m_status(ui.status()),
-      m_style(ui.style()),
+      m_style(ui.panel_style()),
       m_ostyle(ui.ostyle()),
       m_candidateCount(0),
-      m_current_zhung_icon(),
       m_inputPos(CRect()),
       m_sticky(false),
       dpi(96),
       hide_candidates(false),
       pDWR(ui.pdwr()),
       _UICallback(ui.uiCallback()),
+      m_ui(ui),
       _m_gdiplusToken(0) {
-  m_iconDisabled.LoadIconW(IDI_RELOAD, STATUS_ICON_SIZE, STATUS_ICON_SIZE,
-                           LR_DEFAULTCOLOR);
-  m_iconEnabled.LoadIconW(IDI_ZH, STATUS_ICON_SIZE, STATUS_ICON_SIZE,
-                          LR_DEFAULTCOLOR);
-  m_iconAlpha.LoadIconW(IDI_EN, STATUS_ICON_SIZE, STATUS_ICON_SIZE,
-                        LR_DEFAULTCOLOR);
-  m_iconFull.LoadIconW(IDI_FULL_SHAPE, STATUS_ICON_SIZE, STATUS_ICON_SIZE,
-                       LR_DEFAULTCOLOR);
-  m_iconHalf.LoadIconW(IDI_HALF_SHAPE, STATUS_ICON_SIZE, STATUS_ICON_SIZE,
-                       LR_DEFAULTCOLOR);
+  std::fill(std::begin(m_layouts), std::end(m_layouts), (Layout*)NULL);
   // for gdi+ drawings, initialization
   GdiplusStartup(&_m_gdiplusToken, &_m_gdiplusStartupInput, NULL);
 
   HMONITOR hMonitor = MonitorFromRect(m_inputPos, MONITOR_DEFAULTTONEAREST);
-  UINT dpiX = 96, dpiY = 96;
+  UINT dpiX = 96;
   if (hMonitor) {
-    GetDpiForMonitor(hMonitor, MDT_EFFECTIVE_DPI, &dpiX, &dpiY);
+    dpiX = _GetMonitorInfo(hMonitor).dpi;
     m_hMonitor = hMonitor;
   }
   dpi = dpiX;
@@ -90,8 +70,13 @@ WeaselPanel::WeaselPanel(weasel::UI& ui)
 }
 
 WeaselPanel::~WeaselPanel() {
+  m_shadows.clear();
+  _ReleaseBackBuffer();
   Gdiplus::GdiplusShutdown(_m_gdiplusToken);
-  delete m_layout;
+  for (auto& layout : m_layouts) {
+    delete layout;
+    layout = NULL;
+  }
   m_layout = NULL;
   // pDWR.reset();
 }
@@ -105,10 +90,18 @@ void WeaselPanel::_ResizeWindow() {
 }
 
 void WeaselPanel::_CreateLayout() {
-  if (m_layout != NULL)
-    delete m_layout;
+  if (m_style.layout_type < 0 ||
+      m_style.layout_type >= UIStyle::LAYOUT_TYPE_LAST) {
+    m_layout = NULL;
+    return;
+  }
+  Layout*& layout = m_layouts[m_style.layout_type];
+  if (layout != NULL) {
+    layout->Rebind(m_style, pDWR);
+    m_layout = layout;
+    return;
+  }
 
-  Layout* layout = NULL;
   if (m_style.layout_type == UIStyle::LAYOUT_VERTICAL_TEXT) {
     layout = new VHorizontalLayout(m_style, m_ctx, m_status, pDWR);
   } else {
@@ -155,40 +148,108 @@ void WeaselPanel::Refresh() {
   // only RedrawWindow if no need to hide candidates window, or
   // inline_no_candidates
   if (!hide_candidates || inline_no_candidates) {
-    _InitFontRes();
-    _CreateLayout();
-
-    CDCHandle dc = GetDC();
-    m_layout->DoLayout(dc, pDWR);
-    ReleaseDC(dc);
+    bool reinit = _InitFontRes();
+    CSize old_size = m_layout ? m_layout->GetContentSize() : CSize();
+    CRect old_highlight = m_highlightRect;
+    // nothing but the highlight changed, compared in place; rebuilt fonts
+    // change every text
+    const weasel::CandidateInfo& cinfo = m_ctx.cinfo;
+    const weasel::CandidateInfo& ocinfo = m_octx.cinfo;
+    bool highlight_only =
+        !reinit && cinfo.highlighted != ocinfo.highlighted &&
+        cinfo.currentPage == ocinfo.currentPage &&
+        cinfo.totalPages == ocinfo.totalPages &&
+        cinfo.is_last_page == ocinfo.is_last_page &&
+        !cinfo.notequal(cinfo.candies, ocinfo.candies) &&
+        !cinfo.notequal(cinfo.comments, ocinfo.comments) &&
+        !cinfo.notequal(cinfo.labels, ocinfo.labels) &&
+        m_ctx.preedit == m_octx.preedit && m_ctx.aux == m_octx.aux &&
+        m_layoutStatus == m_status;
+    // only the highlight moved: keep the layout without measuring any text
+    if (highlight_only && m_layout && m_layout->UpdateHighlight()) {
+      m_highlightRect = m_layout->GetHighlightRect();
+    } else {
+      std::vector<CRect> old_rects;
+      old_rects.swap(m_candidateRects);
+      _CreateLayout();
+
+      CDCHandle dc = GetDC();
+      m_layout->DoLayout(dc, pDWR);
+      ReleaseDC(dc);
+      for (int i = 0; i < m_candidateCount && i < MAX_CANDIDATES_COUNT; ++i)
+        m_candidateRects.push_back(m_layout->GetCandidateRect(i));
+      m_highlightRect = m_layout->GetHighlightRect();
+      m_layoutStatus = m_status;
+      highlight_only = highlight_only && old_rects == m_candidateRects &&
+                       old_size == m_layout->GetContentSize();
+    }
     _ResizeWindow();
     _RepositionWindow();
+    // moved to another monitor, the whole panel is painted anew
+    highlight_only = highlight_only && !m_redraw_by_monitor_change;
     if (m_ctx != m_octx) {
+      // when only the highlight moved within the same layout, repaint the
+      // two candidates instead of the whole panel
+      int old_highlighted = m_octx.cinfo.highlighted;
       m_octx = m_ctx;
-      RedrawWindow();
+      if (highlight_only) {
+        _RedrawCandidates(old_highlighted, m_ctx.cinfo.highlighted,
+                          old_highlight);
+        UpdateWindow();
+      } else {
+        RedrawWindow();
+      }
     }
   }
 }
 
-void WeaselPanel::_InitFontRes(bool forced) {
-  HMONITOR hMonitor = MonitorFromRect(m_inputPos, MONITOR_DEFAULTTONEAREST);
+const WeaselPanel::MonitorInfo& WeaselPanel::_GetMonitorInfo(
+    HMONITOR hMonitor) {
+  auto it = m_monitors.find(hMonitor);
+  if (it != m_monitors.end())
+    return it->second;
+  MonitorInfo& mi = m_monitors[hMonitor];
   UINT dpiX = 96, dpiY = 96;
+  GetDpiForMonitor(hMonitor, MDT_EFFECTIVE_DPI, &dpiX, &dpiY);
+  mi.dpi = dpiX;
+  MONITORINFO info;
+  info.cbSize = sizeof(MONITORINFO);
+  if (GetMonitorInfo(hMonitor, &info))
+    mi.work = info.rcWork;
+  return mi;
+}
+
+// returns true if the directwrite resources were initialized again
+bool WeaselPanel::_InitFontRes(bool forced) {
+  HMONITOR hMonitor = MonitorFromRect(m_inputPos, MONITOR_DEFAULTTONEAREST);
+  UINT dpiX = 96;
   if (hMonitor)
-    GetDpiForMonitor(hMonitor, MDT_EFFECTIVE_DPI, &dpiX, &dpiY);
+    dpiX = _GetMonitorInfo(hMonitor).dpi;
+  // resources kept for other dpis are set up with the old style
+  if (m_ostyle != m_style)
+    m_dwrs.clear();
   // prepare d2d1 resources
   // if style changed, or dpi changed, or pDWR NULL, re-initialize directwrite
   // resources
-  if (forced || (pDWR == NULL) || (m_ostyle != m_style) || (dpiX != dpi)) {
-    if (pDWR)
-      pDWR->InitResources(m_style, dpiX);
-    else
-      pDWR = std::make_shared<DirectWriteResources>(m_style, dpiX);
-    pDWR->pRenderTarget->SetTextAntialiasMode(
-        (D2D1_TEXT_ANTIALIAS_MODE)m_style.antialias_mode);
+  bool reinit =
+      forced || (pDWR == NULL) || (m_ostyle != m_style) || (dpiX != dpi);
+  if (reinit) {
+    PDWR& dwr = m_dwrs[dpiX];
+    // moving back to a monitor of a known dpi only switches resources
+    if (!dwr || forced) {
+      if (dwr)
+        dwr->InitResources(m_style, dpiX);
+      else
+        dwr = std::make_shared<DirectWriteResources>(m_style, dpiX);
+      dwr->pRenderTarget->SetTextAntialiasMode(
+          (D2D1_TEXT_ANTIALIAS_MODE)m_style.antialias_mode);
+    }
+    pDWR = dwr;
   }
   m_ostyle = m_style;
   dpi = dpiX;
   dpiScaleLayout = (float)dpi / 96.0f;
+  return reinit;
 }
 
 static HBITMAP CopyDCToBitmap(HDC hDC, LPRECT lpRect) {
@@ -453,13 +514,15 @@ LRESULT WeaselPanel::OnMouseMove(UINT uMsg,
           if (_UICallback)
             _UICallback(NULL, &i, NULL, NULL);
         } else if (m_hoverIndex != i) {
+          int old_hover = m_hoverIndex;
           m_hoverIndex = static_cast<int>(i);
-          InvalidateRect(&rcw, true);
+          _RedrawCandidates(old_hover, m_hoverIndex);
         }
       } else if (m_style.hover_type == UIStyle::HoverType::SEMI_HILITE &&
                  m_hoverIndex != -1) {
+        int old_hover = m_hoverIndex;
         m_hoverIndex = -1;
-        InvalidateRect(&rcw, true);
+        _RedrawCandidates(old_hover, -1);
       }
     }
   }
@@ -470,12 +533,110 @@ LRESULT WeaselPanel::OnMouseLeave(UINT uMsg,
                                   WPARAM wParam,
                                   LPARAM lParam,
                                   BOOL& bHandled) {
+  int old_hover = m_hoverIndex;
   m_hoverIndex = -1;
-  InvalidateRect(&rcw, true);
+  _RedrawCandidates(old_hover, -1);
   m_mouse_entry = false;
   return 0;
 }
 
+// area touched when drawing candidate id at rc: highlight padding, mark,
+// border and the blurred shadow around its back
+CRect WeaselPanel::_GetCandidateDamage(CRect rc, int id) {
+  if (m_istorepos)
+    rc.OffsetRect(0, m_offsetys[id]);
+  int mark = m_layout->mark_width + m_layout->mark_gap;
+  rc.InflateRect(
+      DPI_SCALE(m_style.hilite_padding_x) + m_layout->offsetX + mark,
+      DPI_SCALE(m_style.hilite_padding_y) + m_layout->offsetY + mark);
+  return rc;
+}
+
+// repaints candidates a and b (and extra, an old highlight rect) only
+void WeaselPanel::_RedrawCandidates(int a, int b, const CRect& extra) {
+  CRect dirty;
+  for (int id : {a, b}) {
+    if (id < 0 || id >= m_candidateCount || id >= MAX_CANDIDATES_COUNT)
+      continue;
+    dirty.UnionRect(dirty,
+                    _GetCandidateDamage(m_layout->GetCandidateRect(id), id));
+    if (id == m_ctx.cinfo.highlighted)
+      dirty.UnionRect(dirty, _GetCandidateDamage(m_highlightRect, id));
+    else if (id == a && !extra.IsRectEmpty())
+      dirty.UnionRect(dirty, _GetCandidateDamage(extra, id));
+  }
+  if (!dirty.IsRectEmpty())
+    InvalidateRect(&dirty, false);
+}
+
+// shadows only depend on the size of rc, not its position, so moving the
+// highlight reuses the blurred bitmap of the previous frame
+Gdiplus::Bitmap* WeaselPanel::_GetDropShadow(const CRect& rc,
+                                             const COLORREF& shadowColor,
+                                             const int& radius) {
+  static const size_t MAX_CACHED_SHADOWS = 16;
+  int blurMarginX = m_layout->offsetX;
+  int blurMarginY = m_layout->offsetY;
+  ShadowKey key{rc.Width(),
+                rc.Height(),
+                blurMarginX,
+                blurMarginY,
+                radius,
+                DPI_SCALE(m_style.shadow_radius),
+                DPI_SCALE(m_style.shadow_offset_x),
+                DPI_SCALE(m_style.shadow_offset_y),
+                shadowColor};
+  for (auto it = m_shadows.begin(); it != m_shadows.end(); ++it) {
+    if (it->key == key) {
+      m_shadows.splice(m_shadows.begin(), m_shadows, it);
+      return m_shadows.front().bitmap.get();
+    }
+  }
+
+  CRect rect(blurMarginX + key.offset_x, blurMarginY + key.offset_y,
+             rc.Width() + blurMarginX + key.offset_x,
+             rc.Height() + blurMarginY + key.offset_y);
+  BYTE r = GetRValue(shadowColor);
+  BYTE g = GetGValue(shadowColor);
+  BYTE b = GetBValue(shadowColor);
+  BYTE alpha = (BYTE)((shadowColor >> 24) & 255);
+  Gdiplus::Color shadow_color = Gdiplus::Color::MakeARGB(alpha, r, g, b);
+  std::unique_ptr<Gdiplus::Bitmap> pBitmapDropShadow(new Gdiplus::Bitmap(
+      (INT)rc.Width() + blurMarginX * 2, (INT)rc.Height() + blurMarginY * 2,
+      PixelFormat32bppPARGB));
+  if (pBitmapDropShadow->GetLastStatus() != Gdiplus::Ok)
+    return NULL;
+
+  {
+    Gdiplus::Graphics g_shadow(pBitmapDropShadow.get());
+    g_shadow.SetSmoothingMode(Gdiplus::SmoothingModeHighQuality);
+    // dropshadow, draw a roundrectangle to blur
+    if (key.offset_x != 0 || key.offset_y != 0) {
+      GraphicsRoundRectPath shadow_path(rect, radius);
+      Gdiplus::SolidBrush shadow_brush(shadow_color);
+      g_shadow.FillPath(&shadow_brush, &shadow_path);
+    }
+    // round shadow, draw multilines as base round line
+    else {
+      int step = alpha / key.blur / 2;
+      Gdiplus::Pen pen_shadow(shadow_color, (Gdiplus::REAL)1);
+      for (int i = 0; i < key.blur; i++) {
+        GraphicsRoundRectPath round_path(rect, radius + 1 + i);
+        g_shadow.DrawPath(&pen_shadow, &round_path);
+        shadow_color = Gdiplus::Color::MakeARGB(alpha - i * step, r, g, b);
+        pen_shadow.SetColor(shadow_color);
+        rect.InflateRect(1, 1);
+      }
+    }
+  }
+  DoGaussianBlur(pBitmapDropShadow.get(), (float)key.blur, (float)key.blur);
+
+  if (m_shadows.size() >= MAX_CACHED_SHADOWS)
+    m_shadows.pop_back();
+  m_shadows.push_front(CachedShadow{key, std::move(pBitmapDropShadow)});
+  return m_shadows.front().bitmap.get();
+}
+
 void WeaselPanel::_HighlightText(CDCHandle& dc,
                                  const CRect& rc,
                                  const COLORREF& color,
@@ -484,6 +645,13 @@ void WeaselPanel::_HighlightText(CDCHandle& dc,
                                  const BackType& type = BackType::TEXT,
                                  const IsToRoundStruct& rd = IsToRoundStruct(),
                                  const COLORREF& bordercolor = TRANS_COLOR) {
+  // skip backs outside the damage of a partial repaint
+  if (!m_dirty.IsRectEmpty()) {
+    CRect bound(rc);
+    bound.InflateRect(m_layout->offsetX, m_layout->offsetY);
+    if (!bound.IntersectRect(bound, m_dirty))
+      return;
+  }
   // Graphics obj with SmoothingMode
   Gdiplus::Graphics g_back(dc);
   g_back.SetSmoothingMode(Gdiplus::SmoothingMode::SmoothingModeHighQuality);
@@ -508,50 +676,11 @@ void WeaselPanel::_HighlightText(CDCHandle& dc,
   // 必须shadow_color都是非完全透明色才做绘制, 全屏状态不绘制阴影保证响应速度
   if (DPI_SCALE(m_style.shadow_radius) && COLORNOTTRANSPARENT(shadowColor) &&
       NOT_FULLSCREENLAYOUT(m_style)) {
-    CRect rect(blurMarginX + DPI_SCALE(m_style.shadow_offset_x),
-               blurMarginY + DPI_SCALE(m_style.shadow_offset_y),
-               rc.Width() + blurMarginX + DPI_SCALE(m_style.shadow_offset_x),
-               rc.Height() + blurMarginY + DPI_SCALE(m_style.shadow_offset_y));
-    BYTE r = GetRValue(shadowColor);
-    BYTE g = GetGValue(shadowColor);
-    BYTE b = GetBValue(shadowColor);
-    BYTE alpha = (BYTE)((shadowColor >> 24) & 255);
-    Gdiplus::Color shadow_color = Gdiplus::Color::MakeARGB(alpha, r, g, b);
-    static Gdiplus::Bitmap* pBitmapDropShadow;
-    pBitmapDropShadow = new Gdiplus::Bitmap((INT)rc.Width() + blurMarginX * 2,
-                                            (INT)rc.Height() + blurMarginY * 2,
-                                            PixelFormat32bppPARGB);
-
-    Gdiplus::Graphics g_shadow(pBitmapDropShadow);
-    g_shadow.SetSmoothingMode(Gdiplus::SmoothingModeHighQuality);
-    // dropshadow, draw a roundrectangle to blur
-    if (DPI_SCALE(m_style.shadow_offset_x) != 0 ||
-        DPI_SCALE(m_style.shadow_offset_y) != 0) {
-      GraphicsRoundRectPath shadow_path(rect, radius);
-      Gdiplus::SolidBrush shadow_brush(shadow_color);
-      g_shadow.FillPath(&shadow_brush, &shadow_path);
-    }
-    // round shadow, draw multilines as base round line
-    else {
-      int step = alpha / DPI_SCALE(m_style.shadow_radius) / 2;
-      Gdiplus::Pen pen_shadow(shadow_color, (Gdiplus::REAL)1);
-      for (int i = 0; i < DPI_SCALE(m_style.shadow_radius); i++) {
-        GraphicsRoundRectPath round_path(rect, radius + 1 + i);
-        g_shadow.DrawPath(&pen_shadow, &round_path);
-        shadow_color = Gdiplus::Color::MakeARGB(alpha - i * step, r, g, b);
-        pen_shadow.SetColor(shadow_color);
-        rect.InflateRect(1, 1);
-      }
-    }
-    DoGaussianBlur(pBitmapDropShadow, (float)DPI_SCALE(m_style.shadow_radius),
-                   (float)DPI_SCALE(m_style.shadow_radius));
-
-    g_back.DrawImage(pBitmapDropShadow, rc.left - blurMarginX,
-                     rc.top - blurMarginY);
-
-    // free memory
-    delete pBitmapDropShadow;
-    pBitmapDropShadow = NULL;
+    Gdiplus::Bitmap* pBitmapDropShadow =
+        _GetDropShadow(rc, shadowColor, radius);
+    if (pBitmapDropShadow)
+      g_back.DrawImage(pBitmapDropShadow, rc.left - blurMarginX,
+                       rc.top - blurMarginY);
   }
 
   // 必须back_color非完全透明才绘制
@@ -940,13 +1069,57 @@ void WeaselPanel::DoPaint(CDCHandle dc) {
   // turn off WS_EX_TRANSPARENT, for better resp performance
   ModifyStyleEx(WS_EX_TRANSPARENT, WS_EX_LAYERED);
   GetClientRect(&rcw);
-  // prepare memDC
-  CDCHandle hdc = ::GetDC(m_hWnd);
-  CDCHandle memDC = ::CreateCompatibleDC(hdc);
-  HBITMAP memBitmap = ::CreateCompatibleBitmap(hdc, rcw.Width(), rcw.Height());
-  ::SelectObject(memDC, memBitmap);
-  ReleaseDC(hdc);
   bool drawn = false;
+  if (!_DrawFrame(drawn))
+    return;
+  /* Nothing drawn, hide candidate window */
+  if (!hide_candidates && !drawn)
+    ShowWindow(SW_HIDE);
+  _LayerUpdate(rcw, m_memDC.m_hDC, m_dirty.IsRectEmpty() ? NULL : &m_dirty);
+  m_dirty.SetRectEmpty();
+}
+
+// custom schema icons if set, or the built-in ones
+HICON WeaselPanel::_GetStatusIcon() {
+  static const std::wstring builtin;
+  const std::wstring* path = &builtin;
+  UINT id = IDI_RELOAD;
+  if (m_status.disabled) {
+    // under maintenance, always the built-in icon
+  } else if (m_status.ascii_mode) {
+    path = &m_style.current_ascii_icon;
+    id = IDI_EN;
+  } else if (m_status.type == SCHEMA) {
+    path = &m_style.current_zhung_icon;
+    id = IDI_ZH;
+  } else if (m_status.full_shape) {
+    path = &m_style.current_full_icon;
+    id = IDI_FULL_SHAPE;
+  } else {
+    path = &m_style.current_half_icon;
+    id = IDI_HALF_SHAPE;
+  }
+  return IconCache::Get(*path, id, STATUS_ICON_SIZE, STATUS_ICON_SIZE,
+                        ModuleHelper::GetResourceInstance());
+}
+
+// draws the panel of size rcw into the back buffer, returns false if there
+// is no back buffer to draw in
+bool WeaselPanel::_DrawFrame(bool& drawn) {
+  // repaint only the damaged part when the rest of the last frame is intact
+  CRect dirty;
+  if (hide_candidates || !dirty.IntersectRect(m_dirty, rcw) || dirty == rcw)
+    dirty.SetRectEmpty();
+  // prepare memDC
+  if (!_PrepareBackBuffer(rcw.Size(), dirty)) {
+    m_dirty.SetRectEmpty();
+    return false;
+  }
+  m_dirty = dirty;
+  CDCHandle memDC = m_memDC.m_hDC;
+  if (!m_dirty.IsRectEmpty())
+    memDC.IntersectClipRect(&m_dirty);
+  drawn = false;
   if (!hide_candidates) {
     CRect auxrc = m_layout->GetAuxiliaryRect();
     CRect preeditrc = m_layout->GetPreeditRect();
@@ -1009,11 +1182,20 @@ void WeaselPanel::DoPaint(CDCHandle dc) {
 
     // begin  texts drawing, if pRenderTarget failed, force to reinit
     // directwrite resources
-    if (FAILED(pDWR->pRenderTarget->BindDC(memDC, &rcw))) {
-      _InitFontRes(true);
-      pDWR->pRenderTarget->BindDC(memDC, &rcw);
+    if (m_boundTarget != pDWR->pRenderTarget || m_boundRect != rcw) {
+      if (FAILED(pDWR->pRenderTarget->BindDC(memDC, &rcw))) {
+        _InitFontRes(true);
+        pDWR->pRenderTarget->BindDC(memDC, &rcw);
+      }
+      m_boundTarget = pDWR->pRenderTarget;
+      m_boundRect = rcw;
     }
     pDWR->pRenderTarget->BeginDraw();
+    if (!m_dirty.IsRectEmpty())
+      pDWR->pRenderTarget->PushAxisAlignedClip(
+          D2D1::RectF((float)m_dirty.left, (float)m_dirty.top,
+                      (float)m_dirty.right, (float)m_dirty.bottom),
+          D2D1_ANTIALIAS_MODE_ALIASED);
     // draw auxiliary string
     if (!m_ctx.aux.str.empty())
       drawn |= _DrawPreedit(m_ctx.aux, memDC, auxrc);
@@ -1023,20 +1205,13 @@ void WeaselPanel::DoPaint(CDCHandle dc) {
     // draw candidates string
     if (m_candidateCount)
       drawn |= _DrawCandidates(memDC);
+    if (!m_dirty.IsRectEmpty())
+      pDWR->pRenderTarget->PopAxisAlignedClip();
     pDWR->pRenderTarget->EndDraw();
     // end texts drawing
 
     // status icon (I guess Metro IME stole my idea :)
     if (m_layout->ShouldDisplayStatusIcon()) {
-      // decide if custom schema zhung icon to show
-      LoadIconNecessary(m_current_zhung_icon, m_style.current_zhung_icon,
-                        m_iconEnabled, IDI_ZH);
-      LoadIconNecessary(m_current_ascii_icon, m_style.current_ascii_icon,
-                        m_iconAlpha, IDI_EN);
-      LoadIconNecessary(m_current_half_icon, m_style.current_half_icon,
-                        m_iconHalf, IDI_HALF_SHAPE);
-      LoadIconNecessary(m_current_full_icon, m_style.current_full_icon,
-                        m_iconFull, IDI_FULL_SHAPE);
       CRect iconRect(m_layout->GetStatusIconRect());
       if (m_istorepos && !m_ctx.aux.str.empty())
         iconRect.OffsetRect(0, m_offsety_aux);
@@ -1044,29 +1219,103 @@ void WeaselPanel::DoPaint(CDCHandle dc) {
                !m_ctx.preedit.str.empty())
         iconRect.OffsetRect(0, m_offsety_preedit);
 
-      CIcon& icon(
-          m_status.disabled ? m_iconDisabled
-          : m_status.ascii_mode
-              ? m_iconAlpha
-              : (m_status.type == SCHEMA
-                     ? m_iconEnabled
-                     : (m_status.full_shape ? m_iconFull : m_iconHalf)));
-      memDC.DrawIconEx(iconRect.left, iconRect.top, icon, 0, 0);
+      memDC.DrawIconEx(iconRect.left, iconRect.top, _GetStatusIcon(), 0, 0);
       drawn = true;
     }
-    /* Nothing drawn, hide candidate window */
-    if (!drawn)
-      ShowWindow(SW_HIDE);
   }
-  _LayerUpdate(rcw, memDC);
+  if (!m_dirty.IsRectEmpty())
+    memDC.SelectClipRgn(NULL);
+  return true;
+}
 
-  // clean objs
-  ::DeleteDC(memDC);
-  ::DeleteObject(memBitmap);
+bool WeaselPanel::RenderOffscreen(std::vector<BYTE>& pixels, CSize& size) {
+  _InitFontRes();
+  m_candidateCount = (BYTE)m_ctx.cinfo.candies.size();
+  hide_candidates = false;
+  m_istorepos = false;
+  _CreateLayout();
+  CDC dc;
+  if (!dc.CreateCompatibleDC(NULL))
+    return false;
+  m_layout->DoLayout(dc.m_hDC, pDWR);
+  m_candidateRects.clear();
+  for (int i = 0; i < m_candidateCount && i < MAX_CANDIDATES_COUNT; ++i)
+    m_candidateRects.push_back(m_layout->GetCandidateRect(i));
+  m_highlightRect = m_layout->GetHighlightRect();
+  m_layoutStatus = m_status;
+  m_octx = m_ctx;
+
+  size = m_layout->GetContentSize();
+  rcw.SetRect(0, 0, size.cx, size.cy);
+  m_dirty.SetRectEmpty();
+  bool drawn = false;
+  if (size.cx <= 0 || size.cy <= 0 || !_DrawFrame(drawn))
+    return false;
+  ::GdiFlush();
+  pixels.resize((size_t)size.cx * size.cy * 4);
+  for (int y = 0; y < size.cy; ++y)
+    memcpy(&pixels[(size_t)y * size.cx * 4],
+           m_memBits + (size_t)y * m_memSize.cx * 4, (size_t)size.cx * 4);
+  return true;
 }
 
-void WeaselPanel::_LayerUpdate(const CRect& rc, CDCHandle dc) {
-  HDC ScreenDC = ::GetDC(NULL);
+// dirty is cleared when the whole buffer has to be repainted
+bool WeaselPanel::_PrepareBackBuffer(const CSize& size, CRect& dirty) {
+  if (m_memDC.IsNull() && !m_memDC.CreateCompatibleDC(NULL))
+    return false;
+  if (m_memBitmap.IsNull() || size.cx > m_memSize.cx ||
+      size.cy > m_memSize.cy) {
+    // grow geometrically, so a panel getting wider while typing does not
+    // reallocate on every keystroke
+    CSize capacity(max(max(size.cx, m_memSize.cx * 3 / 2), 1),
+                   max(max(size.cy, m_memSize.cy * 3 / 2), 1));
+    BITMAPINFO bmi = {0};
+    bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+    bmi.bmiHeader.biWidth = capacity.cx;
+    bmi.bmiHeader.biHeight = -capacity.cy;  // top-down
+    bmi.bmiHeader.biPlanes = 1;
+    bmi.bmiHeader.biBitCount = 32;
+    bmi.bmiHeader.biCompression = BI_RGB;
+    void* bits = NULL;
+    HBITMAP bitmap =
+        ::CreateDIBSection(m_memDC, &bmi, DIB_RGB_COLORS, &bits, NULL, 0);
+    if (bitmap == NULL)
+      return false;
+    HBITMAP old = m_memDC.SelectBitmap(bitmap);
+    if (m_oldBitmap == NULL)
+      m_oldBitmap = old;
+    m_memBitmap.Attach(bitmap);
+    m_memBits = (BYTE*)bits;
+    m_memSize = capacity;
+    // the D2D target has to be bound to the new bitmap
+    m_boundTarget.Reset();
+    dirty.SetRectEmpty();
+  }
+  // clear the area to repaint, the buffer still holds the previous frame
+  CRect clear = dirty.IsRectEmpty() ? CRect(CPoint(0, 0), size) : dirty;
+  ::GdiFlush();
+  for (int y = clear.top; y < clear.bottom; ++y)
+    memset(m_memBits + ((size_t)y * m_memSize.cx + clear.left) * 4, 0,
+           clear.Width() * 4);
+  return true;
+}
+
+void WeaselPanel::_ReleaseBackBuffer() {
+  m_boundTarget.Reset();
+  if (m_oldBitmap != NULL)
+    m_memDC.SelectBitmap(m_oldBitmap);
+  m_oldBitmap = NULL;
+  if (!m_memBitmap.IsNull())
+    m_memBitmap.DeleteObject();
+  if (!m_memDC.IsNull())
+    m_memDC.DeleteDC();
+  m_memBits = NULL;
+  m_memSize = CSize();
+}
+
+void WeaselPanel::_LayerUpdate(const CRect& rc,
+                               CDCHandle dc,
+                               const CRect* dirty) {
   CRect rect;
   GetWindowRect(&rect);
   POINT WindowPosAtScreen = {rect.left, rect.top};
@@ -1074,9 +1323,32 @@ void WeaselPanel::_LayerUpdate(const CRect& rc, CDCHandle dc) {
   SIZE sz = {rc.Width(), rc.Height()};
 
   BLENDFUNCTION bf = {AC_SRC_OVER, 0, 0XFF, AC_SRC_ALPHA};
-  UpdateLayeredWindow(m_hWnd, ScreenDC, &WindowPosAtScreen, &sz, dc,
-                      &PointOriginal, RGB(0, 0, 0), &bf, ULW_ALPHA);
-  ReleaseDC(ScreenDC);
+  // no screen DC needed, the window is not palette based
+  UPDATELAYEREDWINDOWINFO info = {sizeof(UPDATELAYEREDWINDOWINFO)};
+  info.pptDst = &WindowPosAtScreen;
+  info.psize = &sz;
+  info.hdcSrc = dc;
+  info.pptSrc = &PointOriginal;
+  info.pblend = &bf;
+  info.dwFlags = ULW_ALPHA;
+  info.prcDirty = dirty;
+  UpdateLayeredWindowIndirect(m_hWnd, &info);
+}
+
+LRESULT WeaselPanel::OnPaint(UINT uMsg,
+                             WPARAM wParam,
+                             LPARAM lParam,
+                             BOOL& bHandled) {
+  // CDoubleBufferImpl would create a memory DC per paint only to blit it into
+  // a layered window, which ignores WM_PAINT output
+  if (wParam != NULL) {
+    DoPaint((HDC)wParam);
+  } else {
+    CPaintDC dc(m_hWnd);
+    m_dirty = dc.m_ps.rcPaint;
+    DoPaint(dc.m_hDC);
+  }
+  return 0;
 }
 
 LRESULT WeaselPanel::OnCreate(UINT uMsg,
@@ -1095,7 +1367,7 @@ LRESULT WeaselPanel::OnDestroy(UINT uMsg,
                                BOOL& bHandled) {
   m_hoverIndex = -1;
   m_sticky = false;
-  delete m_layout;
+  // the layouts stay in m_layouts for the next window
   m_layout = NULL;
   return 0;
 }
@@ -1104,10 +1376,22 @@ LRESULT WeaselPanel::OnDpiChanged(UINT uMsg,
                                   WPARAM wParam,
                                   LPARAM lParam,
                                   BOOL& bHandled) {
+  m_monitors.clear();
   Refresh();
   return LRESULT();
 }
 
+LRESULT WeaselPanel::OnDisplayChange(UINT uMsg,
+                                     WPARAM wParam,
+                                     LPARAM lParam,
+                                     BOOL& bHandled) {
+  // monitors rearranged, or the work area changed with the taskbar
+  if (uMsg == WM_DISPLAYCHANGE || wParam == SPI_SETWORKAREA)
+    m_monitors.clear();
+  bHandled = FALSE;
+  return 0;
+}
+
 void WeaselPanel::MoveTo(RECT const& rc) {
   if (!m_layout)
     return;  // avoid handling nullptr in _RepositionWindow
@@ -1121,7 +1405,8 @@ void WeaselPanel::MoveTo(RECT const& rc) {
     RECT irc{p.x - STATUS_ICON_SIZE, p.y - STATUS_ICON_SIZE, p.x, p.y};
     m_inputPos = irc;
     _RepositionWindow(true);
-    RedrawWindow();
+    // painted with the next WM_PAINT, together with any pending refresh
+    Invalidate(FALSE);
   } else if (!(rc.left == m_inputPos.left && rc.bottom != m_inputPos.bottom &&
                abs(rc.bottom - m_inputPos.bottom) < 6) ||
              m_layout->ShouldDisplayStatusIcon()) {
@@ -1137,20 +1422,69 @@ void WeaselPanel::MoveTo(RECT const& rc) {
     // redrawing is required
     if (m_istorepos != m_istorepos_buf || !m_ctx.aux.empty() ||
         m_layout->ShouldDisplayStatusIcon() || m_redraw_by_monitor_change)
-      RedrawWindow();
+      Invalidate(FALSE);
   }
 }
 
+void WeaselPanel::PostUpdate(std::function<void()> update) {
+  // the replaced closure is destroyed with the parameter, after unlocking
+  std::lock_guard<std::mutex> lock(m_posted_mutex);
+  m_posted_update.swap(update);
+  m_hide_last = false;
+  if (!m_posted)
+    m_posted = !!PostMessage(WM_WEASEL_UI_UPDATE);
+}
+
+void WeaselPanel::PostHide() {
+  std::lock_guard<std::mutex> lock(m_posted_mutex);
+  m_posted_hide = true;
+  m_hide_last = true;
+  if (!m_posted)
+    m_posted = !!PostMessage(WM_WEASEL_UI_UPDATE);
+}
+
+void WeaselPanel::PostMoveTo(RECT const& rc) {
+  std::lock_guard<std::mutex> lock(m_posted_mutex);
+  m_posted_rc = rc;
+  m_posted_move = true;
+  if (!m_posted)
+    m_posted = !!PostMessage(WM_WEASEL_UI_UPDATE);
+}
+
+LRESULT WeaselPanel::OnPostedUpdate(UINT uMsg,
+                                    WPARAM wParam,
+                                    LPARAM lParam,
+                                    BOOL& bHandled) {
+  std::function<void()> update;
+  bool move = false, hide = false, hide_last = false;
+  RECT rc;
+  {
+    std::lock_guard<std::mutex> lock(m_posted_mutex);
+    m_posted = false;
+    update.swap(m_posted_update);
+    std::swap(move, m_posted_move);
+    std::swap(hide, m_posted_hide);
+    std::swap(hide_last, m_hide_last);
+    rc = m_posted_rc;
+  }
+  if (move)
+    MoveTo(rc);
+  // in the order they were posted
+  if (hide && !hide_last)
+    m_ui.Hide();
+  if (update)
+    update();
+  if (hide && hide_last)
+    m_ui.Hide();
+  return 0;
+}
+
 void WeaselPanel::_RepositionWindow(const bool& adj) {
   RECT rcWorkArea;
   memset(&rcWorkArea, 0, sizeof(rcWorkArea));
   HMONITOR hMonitor = MonitorFromRect(m_inputPos, MONITOR_DEFAULTTONEAREST);
   if (hMonitor) {
-    MONITORINFO info;
-    info.cbSize = sizeof(MONITORINFO);
-    if (GetMonitorInfo(hMonitor, &info)) {
-      rcWorkArea = info.rcWork;
-    }
+    rcWorkArea = _GetMonitorInfo(hMonitor).work;
     if (hMonitor != m_hMonitor) {
       m_hMonitor = hMonitor;
       m_redraw_by_monitor_change = true;
@@ -1220,6 +1554,9 @@ void WeaselPanel::_TextOut(const CRect& rc,
                            IDWriteTextFormat1* const pTextFormat) {
   if (pTextFormat == NULL)
     return;
+  CRect visible;
+  if (!m_dirty.IsRectEmpty() && !visible.IntersectRect(rc, m_dirty))
+    return;
   float r = (float)(GetRValue(inColor)) / 255.0f;
   float g = (float)(GetGValue(inColor)) / 255.0f;
   float b = (float)(GetBValue(inColor)) / 255.0f;
@@ -1233,14 +1570,20 @@ void WeaselPanel::_TextOut(const CRect& rc,
     pDWR->SetBrushColor(D2D1::ColorF(r, g, b, alpha));
 
   if (NULL != pDWR->pBrush && NULL != pTextFormat) {
-    pDWR->CreateTextLayout(psz.c_str(), (int)cch, pTextFormat,
-                           (float)rc.Width(), (float)rc.Height());
+    // reuse the text layout shaped while measuring in DoLayout
+    ComPtr<IDWriteTextLayout2> pTextLayout =
+        m_layout->GetTextLayout(psz, cch, pTextFormat, pDWR);
+    if (pTextLayout == NULL)
+      return;
+    pTextLayout->SetMaxWidth((float)rc.Width());
+    pTextLayout->SetMaxHeight((float)rc.Height());
     if (m_style.layout_type == UIStyle::LAYOUT_VERTICAL_TEXT) {
       DWRITE_FLOW_DIRECTION flow = m_style.vertical_text_left_to_right
                                        ? DWRITE_FLOW_DIRECTION_LEFT_TO_RIGHT
                                        : DWRITE_FLOW_DIRECTION_RIGHT_TO_LEFT;
-      pDWR->SetLayoutReadingDirection(DWRITE_READING_DIRECTION_TOP_TO_BOTTOM);
-      pDWR->SetLayoutFlowDirection(flow);
+      pTextLayout->SetReadingDirection(
+          DWRITE_READING_DIRECTION_TOP_TO_BOTTOM);
+      pTextLayout->SetFlowDirection(flow);
     }
 
     // offsetx for font glyph over left
@@ -1248,19 +1591,16 @@ void WeaselPanel::_TextOut(const CRect& rc,
     float offsety = (float)rc.top;
     // prepare for space when first character overhanged
     DWRITE_OVERHANG_METRICS omt;
-    pDWR->GetLayoutOverhangMetrics(&omt);
+    pTextLayout->GetOverhangMetrics(&omt);
     if (m_style.layout_type != UIStyle::LAYOUT_VERTICAL_TEXT && omt.left > 0)
       offsetx += omt.left;
     if (m_style.layout_type == UIStyle::LAYOUT_VERTICAL_TEXT && omt.top > 0)
       offsety += omt.top;
 
-    if (pDWR->pTextLayout != NULL) {
-      pDWR->DrawTextLayoutAt({offsetx, offsety});
+    pDWR->DrawTextLayoutAt({offsetx, offsety}, pTextLayout.Get());
 #if 0
-      D2D1_RECT_F rectf =  D2D1::RectF(offsetx, offsety, offsetx + rc.Width(), offsety + rc.Height());
-      pDWR->DrawRect(&rectf);
+    D2D1_RECT_F rectf =  D2D1::RectF(offsetx, offsety, offsetx + rc.Width(), offsety + rc.Height());
+    pDWR->DrawRect(&rectf);
 #endif
-    }
-    pDWR->ResetLayout();
   }
 }
@@ -4,12 +4,20 @@
 #include "StandardLayout.h"
 #include "Layout.h"
 #include "GdiplusBlur.h"
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
 
 #pragma comment(lib, "d2d1.lib")
 #pragma comment(lib, "dwrite.lib")
 
 using namespace weasel;
 
+// posted to the panel when an update from another thread is pending
+#define WM_WEASEL_UI_UPDATE (WM_APP + 1)
+
 typedef CWinTraits<WS_POPUP | WS_CLIPSIBLINGS | WS_DISABLED,
                    WS_EX_TOOLWINDOW | WS_EX_TOPMOST | WS_EX_NOACTIVATE |
                        WS_EX_LAYERED>
@@ -29,18 +37,26 @@ class WeaselPanel
   MESSAGE_HANDLER(WM_CREATE, OnCreate)
   MESSAGE_HANDLER(WM_DESTROY, OnDestroy)
   MESSAGE_HANDLER(WM_DPICHANGED, OnDpiChanged)
+  MESSAGE_HANDLER(WM_DISPLAYCHANGE, OnDisplayChange)
+  MESSAGE_HANDLER(WM_SETTINGCHANGE, OnDisplayChange)
   MESSAGE_HANDLER(WM_MOUSEACTIVATE, OnMouseActivate)
   MESSAGE_HANDLER(WM_LBUTTONUP, OnLeftClickedUp)
   MESSAGE_HANDLER(WM_LBUTTONDOWN, OnLeftClickedDown)
   MESSAGE_HANDLER(WM_MOUSEWHEEL, OnMouseWheel)
   MESSAGE_HANDLER(WM_MOUSEMOVE, OnMouseMove)
   MESSAGE_HANDLER(WM_MOUSELEAVE, OnMouseLeave)
+  MESSAGE_HANDLER(WM_WEASEL_UI_UPDATE, OnPostedUpdate)
+  MESSAGE_HANDLER(WM_PAINT, OnPaint)
   CHAIN_MSG_MAP(CDoubleBufferImpl<WeaselPanel>)
   END_MSG_MAP()
 
   LRESULT OnCreate(UINT uMsg, WPARAM wParam, LPARAM lParam, BOOL& bHandled);
   LRESULT OnDestroy(UINT uMsg, WPARAM wParam, LPARAM lParam, BOOL& bHandled);
   LRESULT OnDpiChanged(UINT uMsg, WPARAM wParam, LPARAM lParam, BOOL& bHandled);
+  LRESULT OnDisplayChange(UINT uMsg,
+                          WPARAM wParam,
+                          LPARAM lParam,
+                          BOOL& bHandled);
   LRESULT OnMouseActivate(UINT uMsg,
                           WPARAM wParam,
                           LPARAM lParam,
@@ -56,13 +72,26 @@ class WeaselPanel
   LRESULT OnMouseWheel(UINT uMsg, WPARAM wParam, LPARAM lParam, BOOL& bHandled);
   LRESULT OnMouseMove(UINT uMsg, WPARAM wParam, LPARAM lParam, BOOL& bHandled);
   LRESULT OnMouseLeave(UINT uMsg, WPARAM wParam, LPARAM lParam, BOOL& bHandled);
+  LRESULT OnPostedUpdate(UINT uMsg,
+                         WPARAM wParam,
+                         LPARAM lParam,
+                         BOOL& bHandled);
+  LRESULT OnPaint(UINT uMsg, WPARAM wParam, LPARAM lParam, BOOL& bHandled);
 
   WeaselPanel(weasel::UI& ui);
   ~WeaselPanel();
 
   void MoveTo(RECT const& rc);
+  // thread safe, run later on the panel's thread; a newer update replaces
+  // the pending one, a hide is kept apart and never drops an update
+  void PostUpdate(std::function<void()> update);
+  void PostHide();
+  void PostMoveTo(RECT const& rc);
   void Refresh();
   void DoPaint(CDCHandle dc);
+  // draws the current context without a window, into top-down rows of
+  // premultiplied BGRA pixels
+  bool RenderOffscreen(std::vector<BYTE>& pixels, CSize& size);
   bool GetIsReposition() { return m_istorepos; }
 
   static VOID CALLBACK OnTimer(_In_ HWND hwnd,
@@ -77,7 +106,12 @@ class WeaselPanel
   int DPI_SCALE(T t) {
     return (int)(t * dpiScaleLayout);
   }
-  void _InitFontRes(bool forced = false);
+  struct MonitorInfo {
+    UINT dpi;
+    CRect work;
+  };
+  const MonitorInfo& _GetMonitorInfo(HMONITOR hMonitor);
+  bool _InitFontRes(bool forced = false);
   void _CaptureRect(CRect& rect);
   bool m_mouse_entry = false;
   void _CreateLayout();
@@ -94,15 +128,26 @@ class WeaselPanel
                       const BackType& type,
                       const IsToRoundStruct& rd,
                       const COLORREF& bordercolor);
+  Gdiplus::Bitmap* _GetDropShadow(const CRect& rc,
+                                  const COLORREF& shadowColor,
+                                  const int& radius);
   void _TextOut(const CRect& rc,
                 const std::wstring& psz,
                 const size_t& cch,
                 const int& inColor,
                 IDWriteTextFormat1* const pTextFormat = NULL);
 
-  void _LayerUpdate(const CRect& rc, CDCHandle dc);
+  bool _DrawFrame(bool& drawn);
+  HICON _GetStatusIcon();
+  void _LayerUpdate(const CRect& rc, CDCHandle dc, const CRect* dirty = NULL);
+  bool _PrepareBackBuffer(const CSize& size, CRect& dirty);
+  CRect _GetCandidateDamage(CRect rc, int id);
+  void _RedrawCandidates(int a, int b, const CRect& extra = CRect());
+  void _ReleaseBackBuffer();
 
   weasel::Layout* m_layout;
+  // one layout of each type, rebound on every refresh
+  weasel::Layout* m_layouts[UIStyle::LAYOUT_TYPE_LAST];
   weasel::Context& m_ctx;
   weasel::Context& m_octx;
   weasel::Status& m_status;
@@ -116,15 +161,6 @@ class WeaselPanel
   int m_offsety_aux;
   bool m_istorepos;
 
-  CIcon m_iconDisabled;
-  CIcon m_iconEnabled;
-  CIcon m_iconAlpha;
-  CIcon m_iconFull;
-  CIcon m_iconHalf;
-  std::wstring m_current_zhung_icon;
-  std::wstring m_current_ascii_icon;
-  std::wstring m_current_half_icon;
-  std::wstring m_current_full_icon;
   // for gdiplus drawings
   Gdiplus::GdiplusStartupInput _m_gdiplusStartupInput;
   ULONG_PTR _m_gdiplusToken;
@@ -138,6 +174,10 @@ class WeaselPanel
   bool m_sticky;
   // for multi font_face & font_point
   PDWR pDWR;
+  // resources of every dpi in use, switched to when the panel changes monitor
+  std::map<UINT, PDWR> m_dwrs;
+  // dpi and work area of monitors, dropped on display or dpi changes
+  std::map<HMONITOR, MonitorInfo> m_monitors;
   std::function<void(size_t* const, size_t* const, bool* const, bool* const)>&
       _UICallback;
   float bar_scale_ = 1.0;
@@ -145,4 +185,58 @@ class WeaselPanel
   int m_hoverIndex = -1;
   HMONITOR m_hMonitor = NULL;
   bool m_redraw_by_monitor_change = false;
+
+  // updates posted from other threads, guarded by m_posted_mutex
+  weasel::UI& m_ui;
+  std::mutex m_posted_mutex;
+  bool m_posted = false;
+  std::function<void()> m_posted_update;
+  bool m_posted_hide = false;
+  // the hide came after the pending update and runs after it
+  bool m_hide_last = false;
+  bool m_posted_move = false;
+  RECT m_posted_rc = {0};
+
+  // blurred drop shadows, most recently used first
+  struct ShadowKey {
+    int width;
+    int height;
+    int margin_x;
+    int margin_y;
+    int radius;
+    int blur;
+    int offset_x;
+    int offset_y;
+    COLORREF color;
+    bool operator==(const ShadowKey& other) const {
+      return width == other.width && height == other.height &&
+             margin_x == other.margin_x && margin_y == other.margin_y &&
+             radius == other.radius && blur == other.blur &&
+             offset_x == other.offset_x && offset_y == other.offset_y &&
+             color == other.color;
+    }
+  };
+  struct CachedShadow {
+    ShadowKey key;
+    std::unique_ptr<Gdiplus::Bitmap> bitmap;
+  };
+  std::list<CachedShadow> m_shadows;
+
+  // back buffer kept for the panel's lifetime, a premultiplied BGRA DIB
+  CDC m_memDC;
+  CBitmap m_memBitmap;
+  HBITMAP m_oldBitmap = NULL;
+  BYTE* m_memBits = NULL;
+  CSize m_memSize;
+  // render target and rect last bound to m_memDC
+  ComPtr<ID2D1DCRenderTarget> m_boundTarget;
+  CRect m_boundRect;
+  // damage of the paint in progress, empty when repainting everything
+  CRect m_dirty;
+  // candidate and highlight rects of the current layout, to tell whether a
+  // new layout only moved the highlight
+  std::vector<CRect> m_candidateRects;
+  CRect m_highlightRect;
+  // status m_layout was computed with
+  weasel::Status m_layoutStatus;
 };
@@ -1,6 +1,14 @@
 #include "stdafx.h"
 #include <WeaselUI.h>
 #include "WeaselPanel.h"
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <dwmapi.h>
+
+#pragma comment(lib, "dwmapi.lib")
 
 using namespace weasel;
 
@@ -8,8 +16,33 @@ class weasel::UIImpl {
  public:
   WeaselPanel panel;
 
-  UIImpl(weasel::UI& ui) : panel(ui), shown(false) {}
+  UIImpl(weasel::UI& ui)
+      : panel(ui), ui(ui), shown(false), pending(false), staged(false) {
+    // one layout and paint per display refresh at most
+    DWM_TIMING_INFO info;
+    memset(&info, 0, sizeof(info));
+    info.cbSize = sizeof(info);
+    if (SUCCEEDED(DwmGetCompositionTimingInfo(NULL, &info)) &&
+        info.rateRefresh.uiNumerator)
+      frame_interval = std::chrono::microseconds(
+          1000000ULL * info.rateRefresh.uiDenominator /
+          info.rateRefresh.uiNumerator);
+  }
   ~UIImpl() {}
+  // whether a refresh now would have to wait for the next frame
+  bool Deferred() const {
+    return paced && shown &&
+           (pending ||
+            std::chrono::steady_clock::now() - last_frame < frame_interval);
+  }
+  // hands the held back content to the panel
+  void Commit() {
+    if (!staged)
+      return;
+    ui.ctx() = std::move(staged_ctx);
+    ui.status() = std::move(staged_status);
+    staged = false;
+  }
   void Refresh() {
     if (!panel.IsWindow())
       return;
@@ -18,27 +51,123 @@ class weasel::UIImpl {
       KillTimer(panel.m_hWnd, AUTOHIDE_TIMER);
       timer = 0;
     }
+    // the first show is painted at once, changes after it once a frame
+    auto elapsed = std::chrono::steady_clock::now() - last_frame;
+    if (!paced || !shown || elapsed >= frame_interval) {
+      RefreshNow();
+      return;
+    }
+    pending = true;
+    if (!frame_timer) {
+      auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(
+          frame_interval - elapsed);
+      // the timer id is the instance, the callback finds its way back
+      SetTimer(panel.m_hWnd, UINT_PTR(this), max((UINT)wait.count(), 1U),
+               &UIImpl::OnFrameTimer);
+      frame_timer = true;
+    }
+  }
+  void RefreshNow() {
+    if (frame_timer) {
+      KillTimer(panel.m_hWnd, UINT_PTR(this));
+      frame_timer = false;
+    }
+    pending = false;
+    last_frame = std::chrono::steady_clock::now();
+    Commit();
     panel.Refresh();
   }
   void Show();
   void Hide();
   void ShowWithTimeout(size_t millisec);
   bool IsShown() const { return shown; }
+  bool StartRenderThread();
+  void StopRenderThread();
 
   static VOID CALLBACK OnTimer(_In_ HWND hwnd,
                                _In_ UINT uMsg,
                                _In_ UINT_PTR idEvent,
                                _In_ DWORD dwTime);
+  static VOID CALLBACK OnFrameTimer(_In_ HWND hwnd,
+                                    _In_ UINT uMsg,
+                                    _In_ UINT_PTR idEvent,
+                                    _In_ DWORD dwTime);
   static const int AUTOHIDE_TIMER = 20121220;
   static UINT_PTR timer;
+  weasel::UI& ui;
   bool shown;
+  // only the server panel on its render thread waits for the next frame;
+  // the TSF candidate list reads ctx() of an in-process UI right back
+  bool paced = false;
+  bool frame_timer = false;
+  // a refresh waiting for the next frame
+  bool pending;
+  // content of the pending refresh, the panel keeps painting what it laid
+  // out until then
+  bool staged;
+  Context staged_ctx;
+  Status staged_status;
+  std::chrono::steady_clock::time_point last_frame;
+  std::chrono::steady_clock::duration frame_interval =
+      std::chrono::milliseconds(16);
+  // owns the panel window and pumps its messages, when used
+  std::thread render_thread;
+  DWORD render_thread_id = 0;
 };
 
 UINT_PTR UIImpl::timer = 0;
 
+namespace {
+using IconKey = std::tuple<std::wstring, UINT, int, int, HINSTANCE>;
+std::mutex icon_mutex;
+std::map<IconKey, HICON> icons;
+// icons of the last generation, still drawn until the next Reset
+std::map<IconKey, HICON> retired_icons;
+
+void DestroyIcons(std::map<IconKey, HICON>& cache) {
+  for (auto& icon : cache) {
+    if (icon.second)
+      DestroyIcon(icon.second);
+  }
+  cache.clear();
+}
+}  // namespace
+
+HICON IconCache::Get(const std::wstring& path,
+                     UINT id,
+                     int cx,
+                     int cy,
+                     HINSTANCE hInstance) {
+  IconKey key(path, path.empty() ? id : 0, cx, cy,
+              path.empty() ? hInstance : NULL);
+  std::lock_guard<std::mutex> lock(icon_mutex);
+  auto it = icons.find(key);
+  if (it != icons.end())
+    return it->second;
+  // failures are kept too, a missing file is not looked up again
+  HICON icon =
+      path.empty()
+          ? (HICON)LoadImage(hInstance, MAKEINTRESOURCE(id), IMAGE_ICON, cx,
+                             cy, LR_DEFAULTCOLOR)
+          : (HICON)LoadImage(NULL, path.c_str(), IMAGE_ICON, cx, cy,
+                             LR_LOADFROMFILE);
+  icons[key] = icon;
+  return icon;
+}
+
+void IconCache::Reset() {
+  std::lock_guard<std::mutex> lock(icon_mutex);
+  // another thread may be drawing an icon handed out just before
+  DestroyIcons(retired_icons);
+  retired_icons.swap(icons);
+}
+
 void UIImpl::Show() {
   if (!panel.IsWindow())
     return;
+  // never show content a frame behind
+  if (!shown && pending)
+    RefreshNow();
   panel.ShowWindow(SW_SHOWNA);
   shown = true;
   if (timer) {
@@ -56,12 +185,19 @@ void UIImpl::Hide() {
     KillTimer(panel.m_hWnd, AUTOHIDE_TIMER);
     timer = 0;
   }
+  // a pending refresh waits for the next show
+  if (frame_timer) {
+    KillTimer(panel.m_hWnd, UINT_PTR(this));
+    frame_timer = false;
+  }
 }
 
 void UIImpl::ShowWithTimeout(size_t millisec) {
   if (!panel.IsWindow())
     return;
   DLOG(INFO) << "ShowWithTimeout: " << millisec;
+  if (!shown && pending)
+    RefreshNow();
   panel.ShowWindow(SW_SHOWNA);
   shown = true;
   SetTimer(panel.m_hWnd, AUTOHIDE_TIMER, static_cast<UINT>(millisec),
@@ -82,7 +218,54 @@ VOID CALLBACK UIImpl::OnTimer(_In_ HWND hwnd,
   }
 }
 
-bool UI::Create(HWND parent) {
+bool UIImpl::StartRenderThread() {
+  HANDLE ready = CreateEvent(NULL, TRUE, FALSE, NULL);
+  if (!ready)
+    return false;
+  render_thread = std::thread([this, ready]() {
+    // no owner window: an owner on another thread would attach its input
+    // queue to ours, and the panel could be held up by it
+    panel.Create(NULL, 0, 0, WS_POPUP,
+                 WS_EX_TOOLWINDOW | WS_EX_TOPMOST | WS_EX_NOACTIVATE |
+                     WS_EX_TRANSPARENT,
+                 0U, 0);
+    render_thread_id = GetCurrentThreadId();
+    SetEvent(ready);
+    MSG msg;
+    while (GetMessage(&msg, NULL, 0, 0) > 0) {
+      TranslateMessage(&msg);
+      DispatchMessage(&msg);
+    }
+  });
+  WaitForSingleObject(ready, INFINITE);
+  CloseHandle(ready);
+  return panel.IsWindow();
+}
+
+void UIImpl::StopRenderThread() {
+  if (!render_thread.joinable())
+    return;
+  // the window can only be destroyed by its own thread
+  if (panel.IsWindow())
+    panel.SendMessage(WM_CLOSE);
+  PostThreadMessage(render_thread_id, WM_QUIT, 0, 0);
+  render_thread.join();
+}
+
+VOID CALLBACK UIImpl::OnFrameTimer(_In_ HWND hwnd,
+                                   _In_ UINT uMsg,
+                                   _In_ UINT_PTR idEvent,
+                                   _In_ DWORD dwTime) {
+  KillTimer(hwnd, idEvent);
+  UIImpl* self = (UIImpl*)idEvent;
+  self->frame_timer = false;
+  if (self->pending)
+    self->RefreshNow();
+}
+
+bool UI::Create(HWND parent, bool render_thread) {
+  if (pimpl_ && render_thread_)
+    return pimpl_->render_thread.joinable() || pimpl_->StartRenderThread();
   if (pimpl_) {
     pimpl_->panel.Create(
         parent, 0, 0, WS_POPUP,
@@ -91,9 +274,13 @@ bool UI::Create(HWND parent) {
     return true;
   }
 
+  render_thread_ = render_thread;
   pimpl_ = new UIImpl(*this);
   if (!pimpl_)
     return false;
+  pimpl_->paced = render_thread_;
+  if (render_thread_)
+    return pimpl_->StartRenderThread();
 
   pimpl_->panel.Create(
       parent, 0, 0, WS_POPUP,
@@ -105,9 +292,15 @@ bool UI::Create(HWND parent) {
 void UI::Destroy(bool full) {
   if (pimpl_) {
     // destroy panel
-    if (pimpl_->panel.IsWindow()) {
+    if (render_thread_) {
+      pimpl_->StopRenderThread();
+    } else if (pimpl_->panel.IsWindow()) {
       pimpl_->panel.DestroyWindow();
     }
+    // timers died with the window
+    pimpl_->frame_timer = false;
+    pimpl_->pending = false;
+    pimpl_->Commit();
     if (full) {
       delete pimpl_;
       pimpl_ = 0;
@@ -161,16 +354,73 @@ void UI::UpdateInputPosition(RECT const& rc) {
   }
 }
 
-void UI::Update(const Context& ctx, const Status& status) {
-  if (ctx_ == ctx && status_ == status)
+void UI::PostUpdate(std::function<void()> update) {
+  // without a window there is nothing to update, and no thread to do it on
+  if (!pimpl_ || !pimpl_->panel.IsWindow())
     return;
+  if (render_thread_) {
+    // style() keeps being written by the caller, hand over a snapshot
+    pimpl_->panel.PostUpdate(
+        [this, style = style_, update = std::move(update)]() {
+          pstyle_ = style;
+          update();
+        });
+  } else {
+    pimpl_->panel.PostUpdate(std::move(update));
+  }
+}
+
+void UI::PostHide() {
+  if (pimpl_ && pimpl_->panel.IsWindow())
+    pimpl_->panel.PostHide();
+}
+
+bool UI::RenderOffscreen(Context const& ctx,
+                         Status const& status,
+                         std::vector<BYTE>& pixels,
+                         SIZE& size) {
+  if (render_thread_)
+    return false;
+  if (!pimpl_)
+    pimpl_ = new UIImpl(*this);
+  pimpl_->staged = false;
   ctx_ = ctx;
   status_ = status;
-  if (style_.candidate_abbreviate_length > 0) {
-    for (auto& c : ctx_.cinfo.candies) {
-      if (c.str.length() > (size_t)style_.candidate_abbreviate_length) {
+  CSize sz;
+  bool ret = pimpl_->panel.RenderOffscreen(pixels, sz);
+  size = sz;
+  return ret;
+}
+
+void UI::PostInputPosition(RECT const& rc) {
+  if (pimpl_ && pimpl_->panel.IsWindow())
+    pimpl_->panel.PostMoveTo(rc);
+}
+
+void UI::Update(const Context& ctx, const Status& status) {
+  // no cached fingerprint: Context is written in place through its public
+  // members (ctx(), the parser), nothing could invalidate one. The compare
+  // stops at the first difference, only an unchanged context is walked
+  // through
+  bool staged = pimpl_ && pimpl_->staged;
+  if ((staged ? pimpl_->staged_ctx : ctx_) == ctx &&
+      (staged ? pimpl_->staged_status : status_) == status)
+    return;
+  // within a frame of the last refresh the panel may still paint, with the
+  // layout of ctx_, so the new content is held back until it is laid out
+  bool defer = pimpl_ && pimpl_->Deferred();
+  Context& next_ctx = defer ? pimpl_->staged_ctx : ctx_;
+  Status& next_status = defer ? pimpl_->staged_status : status_;
+  next_ctx = ctx;
+  next_status = status;
+  if (pimpl_)
+    pimpl_->staged = defer;
+  const UIStyle& style = panel_style();
+  if (style.candidate_abbreviate_length > 0) {
+    for (auto& c : next_ctx.cinfo.candies) {
+      if (c.str.length() > (size_t)style.candidate_abbreviate_length) {
         c.str =
-            c.str.substr(0, (size_t)style_.candidate_abbreviate_length - 1) +
+            c.str.substr(0, (size_t)style.candidate_abbreviate_length - 1) +
             L"..." + c.str.substr(c.str.length() - 1);
       }
     }
@@ -0,0 +1,61 @@
+#pragma once
+#include <list>
+#include <string>
+#include <vector>
+
+// a candidate page as returned by librime, with its serialized ctx.cand line
+struct CandidatePage {
+  CandidatePage() : page_no(0), highlighted(0), is_last_page(false) {}
+  // same candidates in the same place, the payload is not compared
+  bool same(const CandidatePage& other) const {
+    return page_no == other.page_no && highlighted == other.highlighted &&
+           is_last_page == other.is_last_page && texts == other.texts &&
+           comments == other.comments && labels == other.labels;
+  }
+  int page_no;
+  int highlighted;
+  bool is_last_page;
+  std::vector<std::string> texts;
+  std::vector<std::string> comments;
+  std::vector<std::string> labels;
+  std::string payload;
+};
+
+// recently shown and prefetched pages of a session, most recent first
+class CandidatePageCache {
+ public:
+  // current page, the one before and the one after, and a spare
+  static constexpr size_t kMaxPages = 4;
+
+  // the first page match accepts, moved to the front; NULL if none
+  template <typename Match>
+  const CandidatePage* Find(Match match) {
+    for (auto it = pages_.begin(); it != pages_.end(); ++it) {
+      if (match(*it)) {
+        pages_.splice(pages_.begin(), pages_, it);
+        return &pages_.front();
+      }
+    }
+    return NULL;
+  }
+  // looks without making the page recent
+  bool Contains(const CandidatePage& page) const {
+    for (const auto& cached : pages_) {
+      if (cached.same(page))
+        return true;
+    }
+    return false;
+  }
+  // put in front, the least recently used falls off past kMaxPages
+  const CandidatePage& Add(CandidatePage&& page) {
+    pages_.push_front(std::move(page));
+    while (pages_.size() > kMaxPages)
+      pages_.pop_back();
+    return pages_.front();
+  }
+  size_t size() const { return pages_.size(); }
+  void clear() { pages_.clear(); }
+
+ private:
+  std::list<CandidatePage> pages_;
+};
@@ -27,6 +27,10 @@ class PipeChannelBase {
   size_t _WritePipe(HANDLE p, size_t s, char* b);
   void _FinalizePipe(HANDLE& p);
   void _Receive(HANDLE pipe, LPVOID msg, size_t rec_len);
+  /* Read message head, return true if a body is left in the pipe */
+  bool _ReceiveHead(HANDLE pipe, LPVOID msg, size_t rec_len);
+  /* Read message body into buffer */
+  void _ReceiveBody(HANDLE pipe);
   /* Try to get a connection from client */
   HANDLE _ConnectServerPipe(std::wstring& pn);
   inline bool _Invalid(HANDLE p) const { return p == INVALID_HANDLE_VALUE; }
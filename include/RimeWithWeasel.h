@@ -1,25 +1,24 @@
 #pragma once
 #include <WeaselIPC.h>
 #include <WeaselUI.h>
+#include <CandidatePageCache.h>
+#include <list>
 #include <map>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include <rime_api.h>
 
-struct CaseInsensitiveCompare {
-  bool operator()(const std::string& str1, const std::string& str2) const {
-    std::string str1Lower, str2Lower;
-    std::transform(str1.begin(), str1.end(), std::back_inserter(str1Lower),
-                   [](char c) { return std::tolower(c); });
-    std::transform(str2.begin(), str2.end(), std::back_inserter(str2Lower),
-                   [](char c) { return std::tolower(c); });
-    return str1Lower < str2Lower;
-  }
+// options of one app, in config order, ready to be applied to a session
+struct AppOptions {
+  AppOptions() : has_inline_preedit(false), inline_preedit(false) {}
+  std::vector<std::pair<std::string, bool>> options;
+  bool has_inline_preedit;
+  bool inline_preedit;
 };
-
-typedef std::map<std::string, bool> AppOptions;
-typedef std::map<std::string, AppOptions, CaseInsensitiveCompare>
-    AppOptionsByAppName;
+// keyed by lower-cased app name
+typedef std::unordered_map<std::string, AppOptions> AppOptionsByAppName;
 
 struct SessionStatus {
   SessionStatus() : style(weasel::UIStyle()), __synced(false), session_id(0) {
@@ -29,6 +28,12 @@ struct SessionStatus {
   RimeStatus status;
   bool __synced;
   RimeSessionId session_id;
+  CandidatePageCache pages;
+  // the shown page has a neighbour worth prefetching
+  bool prefetch = false;
+  // keys the schema leaves alone in ascii mode, published to the client;
+  // its generation moves on when the mode changes behind the client's back
+  weasel::KeyFilter key_filter;
 };
 typedef std::map<DWORD, SessionStatus> SessionStatusMap;
 typedef DWORD WeaselSessionId;
@@ -39,6 +44,7 @@ class RimeWithWeaselHandler : public weasel::RequestHandler {
   virtual void Initialize();
   virtual void Finalize();
   virtual DWORD FindSession(WeaselSessionId ipc_id);
+  virtual DWORD KeyFilterGeneration(WeaselSessionId ipc_id);
   virtual DWORD AddSession(LPWSTR buffer, EatLine eat = 0);
   virtual DWORD RemoveSession(WeaselSessionId ipc_id);
   virtual BOOL ProcessKeyEvent(weasel::KeyEvent keyEvent,
@@ -61,8 +67,12 @@ class RimeWithWeaselHandler : public weasel::RequestHandler {
                          const std::string& opt,
                          bool val);
   virtual void UpdateColorTheme(BOOL darkMode);
+  virtual bool NeedsPrefetch(WeaselSessionId ipc_id);
+  virtual void Prefetch(WeaselSessionId ipc_id,
+                        std::function<bool()> const& preempted);
 
-  void OnUpdateUI(std::function<void()> const& cb);
+  // cb runs with the status of each update, on the ui thread
+  void OnUpdateUI(std::function<void(weasel::Status const&)> const& cb);
 
  private:
   void _Setup();
@@ -74,9 +84,10 @@ class RimeWithWeaselHandler : public weasel::RequestHandler {
                                 bool ignore_app_name = false);
   bool _ShowMessage(weasel::Context& ctx, weasel::Status& status);
   bool _Respond(WeaselSessionId ipc_id, EatLine eat);
+  void _InvalidateKeyFilter(WeaselSessionId ipc_id);
   void _ReadClientInfo(WeaselSessionId ipc_id, LPWSTR buffer);
   void _GetCandidateInfo(weasel::CandidateInfo& cinfo, RimeContext& ctx);
-  void _GetStatus(weasel::Status& stat,
+  bool _GetStatus(weasel::Status& stat,
                   WeaselSessionId ipc_id,
                   weasel::Context& ctx);
   void _GetContext(weasel::Context& ctx, RimeSessionId session_id);
@@ -104,7 +115,7 @@ class RimeWithWeaselHandler : public weasel::RequestHandler {
   weasel::UIStyle m_base_style;
   std::map<std::string, bool> m_show_notifications;
   std::map<std::string, bool> m_show_notifications_base;
-  std::function<void()> _UpdateUICallback;
+  std::function<void(weasel::Status const&)> _UpdateUICallback;
 
   static void OnNotify(void* context_object,
                        uintptr_t session_id,
@@ -115,6 +126,8 @@ class RimeWithWeaselHandler : public weasel::RequestHandler {
   static std::string m_message_label;
   static std::string m_option_name;
   SessionStatusMap m_session_status_map;
+  // status as last sent to the ui
+  weasel::Status m_status;
   bool m_current_dark_mode;
   bool m_global_ascii_mode;
   int m_show_notifications_time;
@@ -31,6 +31,7 @@ enum WEASEL_IPC_COMMAND {
   WEASEL_IPC_SELECT_CANDIDATE_ON_CURRENT_PAGE,
   WEASEL_IPC_HIGHLIGHT_CANDIDATE_ON_CURRENT_PAGE,
   WEASEL_IPC_CHANGE_PAGE,
+  WEASEL_IPC_KEY_FILTER_GENERATION,
   WEASEL_IPC_LAST_COMMAND
 };
 
@@ -66,6 +67,8 @@ struct RequestHandler {
   virtual void Initialize() {}
   virtual void Finalize() {}
   virtual DWORD FindSession(DWORD session_id) { return 0; }
+  // 0 if the session is gone, so a client never keeps an outdated filter
+  virtual DWORD KeyFilterGeneration(DWORD session_id) { return 0; }
   virtual DWORD AddSession(LPWSTR buffer, EatLine eat = 0) { return 0; }
   virtual DWORD RemoveSession(DWORD session_id) { return 0; }
   virtual BOOL ProcessKeyEvent(KeyEvent keyEvent,
@@ -91,6 +94,12 @@ struct RequestHandler {
   virtual void EndMaintenance() {}
   virtual void SetOption(DWORD session_id, const std::string& opt, bool val) {}
   virtual void UpdateColorTheme(BOOL darkMode) {}
+  // whether the last reply to the session left something to prefetch
+  virtual bool NeedsPrefetch(DWORD session_id) { return false; }
+  // called after the reply has been sent, to prepare for the next request;
+  // gives up as soon as preempted() tells of a request waiting
+  virtual void Prefetch(DWORD session_id,
+                        std::function<bool()> const& preempted) {}
 };
 
 // 處理server端回應之物件
@@ -130,6 +139,8 @@ class Client {
   void EndMaintenance();
   // 测试连接
   bool Echo();
+  // 按鍵過濾表的當前版本，連接或會話失效時爲0
+  UINT KeyFilterGeneration();
   // 请求服务处理按键消息
   bool ProcessKeyEvent(KeyEvent const& keyEvent);
   // 上屏正在編輯的文字
@@ -1,5 +1,7 @@
 ﻿#pragma once
 
+#include <algorithm>
+#include <bitset>
 #include <string>
 #include <vector>
 #include <boost/serialization/vector.hpp>
@@ -13,10 +15,10 @@ struct TextRange {
   TextRange() : start(0), end(0), cursor(-1) {}
   TextRange(int _start, int _end, int _cursor)
       : start(_start), end(_end), cursor(_cursor) {}
-  bool operator==(const TextRange& tr) {
+  bool operator==(const TextRange& tr) const {
     return (start == tr.start && end == tr.end && cursor == tr.cursor);
   }
-  bool operator!=(const TextRange& tr) {
+  bool operator!=(const TextRange& tr) const {
     return (start != tr.start || end != tr.end || cursor != tr.cursor);
   }
   int start;
@@ -28,10 +30,10 @@ struct TextAttribute {
   TextAttribute() : type(NONE) {}
   TextAttribute(int _start, int _end, TextAttributeType _type)
       : range(_start, _end, -1), type(_type) {}
-  bool operator==(const TextAttribute& ta) {
+  bool operator==(const TextAttribute& ta) const {
     return (range == ta.range && type == ta.type);
   }
-  bool operator!=(const TextAttribute& ta) {
+  bool operator!=(const TextAttribute& ta) const {
     return (range != ta.range || type != ta.type);
   }
   TextRange range;
@@ -46,7 +48,7 @@ struct Text {
     attributes.clear();
   }
   bool empty() const { return str.empty(); }
-  bool operator==(const Text& txt) {
+  bool operator==(const Text& txt) const {
     if (str != txt.str || (attributes.size() != txt.attributes.size()))
       return false;
     for (size_t i = 0; i < attributes.size(); i++) {
@@ -55,7 +57,7 @@ struct Text {
     }
     return true;
   }
-  bool operator!=(const Text& txt) {
+  bool operator!=(const Text& txt) const {
     if (str != txt.str || (attributes.size() != txt.attributes.size()))
       return true;
     for (size_t i = 0; i < attributes.size(); i++) {
@@ -84,7 +86,7 @@ struct CandidateInfo {
     labels.clear();
   }
   bool empty() const { return candies.empty(); }
-  bool operator==(const CandidateInfo& ci) {
+  bool operator==(const CandidateInfo& ci) const {
     if (currentPage != ci.currentPage || totalPages != ci.totalPages ||
         highlighted != ci.highlighted || is_last_page != ci.is_last_page ||
         notequal(candies, ci.candies) || notequal(comments, ci.comments) ||
@@ -92,7 +94,7 @@ struct CandidateInfo {
       return false;
     return true;
   }
-  bool operator!=(const CandidateInfo& ci) {
+  bool operator!=(const CandidateInfo& ci) const {
     if (currentPage != ci.currentPage || totalPages != ci.totalPages ||
         highlighted != ci.highlighted || is_last_page != ci.is_last_page ||
         notequal(candies, ci.candies) || notequal(comments, ci.comments) ||
@@ -100,7 +102,8 @@ struct CandidateInfo {
       return true;
     return false;
   }
-  bool notequal(std::vector<Text> txtSrc, std::vector<Text> txtDst) {
+  static bool notequal(const std::vector<Text>& txtSrc,
+                       const std::vector<Text>& txtDst) {
     if (txtSrc.size() != txtDst.size())
       return true;
     for (size_t i = 0; i < txtSrc.size(); i++) {
@@ -126,12 +129,12 @@ struct Context {
     cinfo.clear();
   }
   bool empty() const { return preedit.empty() && aux.empty() && cinfo.empty(); }
-  bool operator==(const Context& ctx) {
+  bool operator==(const Context& ctx) const {
     if (preedit == ctx.preedit && aux == ctx.aux && cinfo == ctx.cinfo)
       return true;
     return false;
   }
-  bool operator!=(const Context& ctx) { return !(operator==(ctx)); }
+  bool operator!=(const Context& ctx) const { return !(operator==(ctx)); }
 
   bool operator!() {
     if (preedit.str.empty() && aux.str.empty() && cinfo.candies.empty() &&
@@ -146,6 +149,71 @@ struct Context {
 };
 // for icon type in tip
 enum IconType { SCHEMA, FULL_SHAPE };
+// 服務端不會處理的按鍵，前端可直接交給應用程序；
+// 按鍵綁定用到的按鍵列為例外，照常發送；
+// 服務端未經回應改變了輸入模式時遞增 generation，前端據此作廢舊表
+struct KeyFilter {
+  // keycodes 0x00-0xff and 0xff00-0xffff, pressed or released alone
+  static const int SIZE = 512;
+  static int index(unsigned int keycode) {
+    if (keycode < 0x100)
+      return (int)keycode;
+    if (keycode >= 0xff00 && keycode <= 0xffff)
+      return (int)(keycode - 0xff00 + 0x100);
+    return -1;
+  }
+  // keeps the generation, an empty filter skips nothing anyway
+  void clear() {
+    keys.reset();
+    exceptions.clear();
+  }
+  bool empty() const { return keys.none(); }
+  // true if the key can be left to the application
+  bool skip(unsigned int keycode, unsigned int mask) const {
+    // any modifier but release may complete a key binding
+    const unsigned int RELEASE_MASK = 1 << 14;
+    int i = index(keycode);
+    if (i < 0 || !keys.test(i) || (mask & ~RELEASE_MASK))
+      return false;
+    return std::find(exceptions.begin(), exceptions.end(),
+                     keycode | mask << 16) == exceptions.end();
+  }
+  // keycode | mask << 16 of a key to send even if its bit is set
+  void except(unsigned int key) {
+    if (std::find(exceptions.begin(), exceptions.end(), key) ==
+        exceptions.end())
+      exceptions.push_back(key);
+  }
+  // generation and ':', the key bitmap in hex, highest nibble first, then
+  // ';' and the exceptions, all in hex separated by ','
+  std::string format() const {
+    static const char hex[] = "0123456789abcdef";
+    auto append = [](std::string& text, unsigned int value) {
+      std::string digits;
+      for (; value || digits.empty(); value >>= 4)
+        digits.insert(digits.begin(), hex[value & 0xf]);
+      text += digits;
+    };
+    std::string text;
+    if (empty())
+      return text;
+    append(text, generation);
+    text.push_back(':');
+    for (int i = SIZE - 4; i >= 0; i -= 4)
+      text.push_back(hex[keys.test(i) | keys.test(i + 1) << 1 |
+                         keys.test(i + 2) << 2 | keys.test(i + 3) << 3]);
+    for (size_t i = 0; i < exceptions.size(); ++i) {
+      text.push_back(i ? ',' : ';');
+      append(text, exceptions[i]);
+    }
+    return text;
+  }
+  std::bitset<SIZE> keys;
+  std::vector<unsigned int> exceptions;
+  // never 0, which the server answers for an unknown session
+  unsigned int generation = 1;
+};
+
 // 由ime管理
 struct Status {
   Status()
@@ -162,8 +230,9 @@ struct Status {
     disabled = false;
     full_shape = false;
     type = SCHEMA;
+    key_filter.clear();
   }
-  bool operator==(const Status status) {
+  bool operator==(const Status& status) const {
     return (status.schema_name == schema_name &&
             status.schema_id == schema_id && status.ascii_mode == ascii_mode &&
             status.composing == composing && status.disabled == disabled &&
@@ -183,6 +252,8 @@ struct Status {
   bool full_shape;
   // 图标类型, schema/full_shape
   IconType type;
+  // 不必送往服務端的按鍵
+  KeyFilter key_filter;
 };
 
 // 用於向前端告知設置信息
@@ -246,6 +317,7 @@ struct UIStyle {
   bool vertical_text_left_to_right;
   bool vertical_text_with_wrap;
   // layout, with key name like style/layout/...
+  bool balanced_wrap;
   int min_width;
   int max_width;
   int min_height;
@@ -319,6 +391,7 @@ struct UIStyle {
         align_type(ALIGN_BOTTOM),
         vertical_text_left_to_right(false),
         vertical_text_with_wrap(false),
+        balanced_wrap(false),
         min_width(0),
         max_width(0),
         min_height(0),
@@ -368,6 +441,7 @@ struct UIStyle {
         preedit_type != st.preedit_type || layout_type != st.layout_type ||
         vertical_text_left_to_right != st.vertical_text_left_to_right ||
         vertical_text_with_wrap != st.vertical_text_with_wrap ||
+        balanced_wrap != st.balanced_wrap ||
         paging_on_scroll != st.paging_on_scroll || font_face != st.font_face ||
         label_font_face != st.label_font_face ||
         comment_font_face != st.comment_font_face ||
@@ -454,6 +528,7 @@ void serialize(Archive& ar, weasel::UIStyle& s, const unsigned int version) {
   ar & s.layout_type;
   ar & s.vertical_text_left_to_right;
   ar & s.vertical_text_with_wrap;
+  ar & s.balanced_wrap;
   ar & s.paging_on_scroll;
   ar & s.min_width;
   ar & s.max_width;
@@ -2,6 +2,9 @@
 
 #include <WeaselIPCData.h>
 #include <vector>
+#include <list>
+#include <map>
+#include <unordered_map>
 #include <regex>
 #include <iterator>
 #include <d2d1.h>
@@ -30,6 +33,46 @@ template <class T>
 using an = std::shared_ptr<T>;
 
 using PDWR = an<DirectWriteResources>;
+
+// what a measured text size depends on, besides the fonts and dpi
+struct TextSizeKey {
+  std::wstring text;
+  IDWriteTextFormat1* format;
+  int max_width;
+  int max_height;
+  bool vertical;
+  bool left_to_right;
+  bool operator==(const TextSizeKey& key) const {
+    return text == key.text && format == key.format &&
+           max_width == key.max_width && max_height == key.max_height &&
+           vertical == key.vertical && left_to_right == key.left_to_right;
+  }
+};
+
+struct TextSizeKeyHash {
+  size_t operator()(const TextSizeKey& key) const {
+    size_t h = std::hash<std::wstring>()(key.text);
+    h = h * 31 + std::hash<void*>()(key.format);
+    h = h * 31 + key.max_width;
+    h = h * 31 + key.max_height;
+    return h * 4 + key.vertical * 2 + key.left_to_right;
+  }
+};
+//
+// 进程内共用的图标，候选窗状态图标与托盘图标都从这里取，部署后 Reset
+//
+class IconCache {
+ public:
+  // path 非空时自文件加载，否则加载 hInstance 中的资源 id；
+  // 返回的图标由缓存持有，调用者不可销毁
+  static HICON Get(const std::wstring& path,
+                   UINT id,
+                   int cx,
+                   int cy,
+                   HINSTANCE hInstance);
+  static void Reset();
+};
+
 //
 // 输入法界面接口类
 //
@@ -46,7 +89,8 @@ class UI {
   }
 
   // 创建输入法界面
-  bool Create(HWND parent);
+  // render_thread: 界面在独立的绘制线程上运行，只能经 Post* 更新
+  bool Create(HWND parent, bool render_thread = false);
 
   // 销毁界面
   void Destroy(bool full = false);
@@ -67,10 +111,26 @@ class UI {
   // 更新界面显示内容
   void Update(Context const& ctx, Status const& status);
 
+  // 不经窗口把界面绘制到内存，逐行自上而下的预乘 alpha BGRA 像素；
+  // 供性能测试与像素比对，不可与绘制线程同用
+  bool RenderOffscreen(Context const& ctx,
+                       Status const& status,
+                       std::vector<BYTE>& pixels,
+                       SIZE& size);
+
+  // 可在其他线程调用，交由界面线程执行；未执行的更新被新的更新取代，
+  // 隐藏另行记下，不会挤掉更新；界面未创建时更新被丢弃
+  void PostUpdate(std::function<void()> update);
+  void PostHide();
+  void PostInputPosition(RECT const& rc);
+
   Context& ctx() { return ctx_; }
   Context& octx() { return octx_; }
   Status& status() { return status_; }
   UIStyle& style() { return style_; }
+  // what the panel draws with, a snapshot of style() taken by PostUpdate
+  // when the panel runs on a render thread
+  UIStyle& panel_style() { return render_thread_ ? pstyle_ : style_; }
   UIStyle& ostyle() { return ostyle_; }
   PDWR pdwr() { return pDWR; }
   bool GetIsReposition();
@@ -94,7 +154,9 @@ class UI {
   Context octx_;
   Status status_;
   UIStyle style_;
+  UIStyle pstyle_;
   UIStyle ostyle_;
+  bool render_thread_ = false;
   std::function<void(size_t* const, size_t* const, bool* const, bool* const)>
       _UICallback;
 };
@@ -143,12 +205,24 @@ class DirectWriteResources {
     pRenderTarget->DrawTextLayout(point, pTextLayout.Get(), pBrush.Get(),
                                   D2D1_DRAW_TEXT_OPTIONS_ENABLE_COLOR_FONT);
   }
+  void DrawTextLayoutAt(const D2D1_POINT_2F& point,
+                        IDWriteTextLayout* textLayout) {
+    pRenderTarget->DrawTextLayout(point, textLayout, pBrush.Get(),
+                                  D2D1_DRAW_TEXT_OPTIONS_ENABLE_COLOR_FONT);
+  }
   HRESULT CreateBrush(const D2D1_COLOR_F& color) {
     return pRenderTarget->CreateSolidColorBrush(color, pBrush.GetAddressOf());
   }
   void ResetLayout() { pTextLayout.Reset(); }
   void SetBrushColor(const D2D1_COLOR_F& color) { pBrush->SetColor(color); }
   void SetDpi(const UINT& dpi);
+  // LRU cache of measured text sizes, cleared when text formats are rebuilt
+  bool FindTextSize(const TextSizeKey& key, SIZE* size);
+  void CacheTextSize(const TextSizeKey& key, const SIZE& size);
+  // shaped once for strings drawn in every frame, as labels and the mark,
+  // kept until text formats are rebuilt
+  ComPtr<IDWriteTextLayout2> GetStaticTextLayout(const std::wstring& text,
+                                                 IDWriteTextFormat1* format);
 
   float dpiScaleFontPoint, dpiScaleLayout;
   ComPtr<ID2D1Factory> pD2d1Factory;
@@ -163,6 +237,18 @@ class DirectWriteResources {
 
  private:
   UIStyle& _style;
+  using TextSizeList = std::list<std::pair<TextSizeKey, SIZE>>;
+  TextSizeList _textSizes;
+  std::unordered_map<TextSizeKey, TextSizeList::iterator, TextSizeKeyHash>
+      _textSizeIndex;
+  std::map<std::pair<std::wstring, IDWriteTextFormat1*>,
+           ComPtr<IDWriteTextLayout2>>
+      _staticTextLayouts;
+  HRESULT _GetTextFormat(const std::wstring& font_face,
+                         const int& font_point,
+                         const DWRITE_WORD_WRAPPING& wrapping,
+                         const bool& vertical_text,
+                         ComPtr<IDWriteTextFormat1>& textFormat);
   void _ParseFontFace(const std::wstring& fontFaceStr,
                       DWRITE_FONT_WEIGHT& fontWeight,
                       DWRITE_FONT_STYLE& fontStyle);
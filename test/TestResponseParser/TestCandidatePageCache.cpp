@@ -0,0 +1,48 @@
+﻿#include "stdafx.h"
+#include <boost/detail/lightweight_test.hpp>
+#include <CandidatePageCache.h>
+
+static CandidatePage make_page(int page_no, const char* first) {
+  CandidatePage page;
+  page.page_no = page_no;
+  page.texts = {first, "二", "三"};
+  page.comments = {"", "", ""};
+  page.labels = {"1", "2", "3"};
+  page.payload = std::string("ctx.cand=") + first + "\n";
+  return page;
+}
+
+void test_candidate_page_cache() {
+  CandidatePageCache cache;
+  auto page_of = [](int page_no) {
+    return [page_no](const CandidatePage& page) {
+      return page.page_no == page_no;
+    };
+  };
+  BOOST_TEST(!cache.Find(page_of(0)));
+
+  for (int i = 0; i < 3; ++i)
+    cache.Add(make_page(i, "一"));
+  BOOST_TEST_EQ(3u, cache.size());
+  // a hit comes back with its payload and becomes the most recent
+  const CandidatePage* hit = cache.Find(page_of(0));
+  BOOST_TEST(hit && hit->payload == "ctx.cand=一\n");
+
+  // the least recently used page, 1, is the one to go
+  cache.Add(make_page(3, "一"));
+  cache.Add(make_page(4, "一"));
+  BOOST_TEST_EQ(CandidatePageCache::kMaxPages, cache.size());
+  BOOST_TEST(!cache.Find(page_of(1)));
+  BOOST_TEST(cache.Find(page_of(0)));
+  BOOST_TEST(cache.Find(page_of(2)));
+
+  // a prefetched page is not cached twice, a changed one is a new page
+  BOOST_TEST(cache.Contains(make_page(2, "一")));
+  BOOST_TEST(!cache.Contains(make_page(2, "壹")));
+  CandidatePage highlighted = make_page(2, "一");
+  highlighted.highlighted = 1;
+  BOOST_TEST(!cache.Contains(highlighted));
+
+  cache.clear();
+  BOOST_TEST_EQ(0u, cache.size());
+}
@@ -6,6 +6,8 @@
 #include <ResponseParser.h>
 #include <string>
 
+void test_candidate_page_cache();
+
 void test_1() {
   WCHAR resp[] = L"action=noop\n";
   DWORD len = wcslen(resp);
@@ -85,11 +87,51 @@ void test_4() {
   BOOST_TEST_EQ(1, c.totalPages);
 }
 
+void test_5() {
+  weasel::KeyFilter sent;
+  for (unsigned int keycode = 0x20; keycode <= 0x7e; ++keycode)
+    sent.keys.set(weasel::KeyFilter::index(keycode));
+  sent.keys.set(weasel::KeyFilter::index(0xff09));
+  sent.keys.set(weasel::KeyFilter::index(0xffff));
+  sent.except(0x2d);
+  sent.except(0xff09);
+  sent.except(0x2d);
+  sent.generation = 0x1c;
+  BOOST_TEST(2 == sent.exceptions.size());
+  std::string text = sent.format();
+  std::wstring resp = L"action=status\n"
+                      L"status.key_filter=" +
+                      std::wstring(text.begin(), text.end()) + L"\n";
+  std::wstring commit;
+  weasel::Context ctx;
+  weasel::Status status;
+  weasel::ResponseParser parser(&commit, &ctx, &status);
+  parser(&resp[0], (UINT)resp.size());
+  weasel::KeyFilter& received = status.key_filter;
+  BOOST_TEST(received.keys == sent.keys);
+  BOOST_TEST(received.exceptions == sent.exceptions);
+  BOOST_TEST_EQ(0x1cu, received.generation);
+  BOOST_TEST(received.skip(0x61, 0));
+  BOOST_TEST(!received.skip(0x61, 1 << 2));
+  BOOST_TEST(!received.skip(0x2d, 0));
+  BOOST_TEST(!received.skip(0xff09, 0));
+  BOOST_TEST(received.skip(0xffff, 1 << 14));
+  BOOST_TEST(!received.skip(0xff0d, 0));
+
+  // an empty filter clears the last one
+  resp = L"action=status\nstatus.key_filter=\n";
+  parser(&resp[0], (UINT)resp.size());
+  BOOST_TEST(status.key_filter.empty());
+  BOOST_TEST(status.key_filter.exceptions.empty());
+}
+
 int _tmain(int argc, _TCHAR* argv[]) {
   test_1();
   test_2();
   test_3();
   test_4();
+  test_5();
+  test_candidate_page_cache();
 
   system("pause");
   return boost::report_errors();
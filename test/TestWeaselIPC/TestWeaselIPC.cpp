@@ -8,16 +8,20 @@
 #include <boost/interprocess/streams/bufferstream.hpp>
 using namespace boost::interprocess;
 
+#include <atomic>
 #include <iostream>
 #include <memory>
+#include <thread>
+#include <vector>
 
 CAppModule _Module;
 
 int console_main();
 int client_main();
 int server_main();
+int stress_main();
 
-// usage: TestWeaselIPC.exe [/start | /stop | /console]
+// usage: TestWeaselIPC.exe [/start | /stop | /console | /stress]
 
 int _tmain(int argc, _TCHAR* argv[]) {
   if (argc == 1)  // no args
@@ -36,6 +40,8 @@ int _tmain(int argc, _TCHAR* argv[]) {
   } else if (argc > 1 && !wcscmp(L"/console", argv[1])) {
     return console_main();
     return 0;
+  } else if (argc > 1 && !wcscmp(L"/stress", argv[1])) {
+    return stress_main();
   }
 
   return -1;
@@ -128,6 +134,43 @@ int client_main() {
   return 0;
 }
 
+// many clients typing at once, each must get back its own replies
+int stress_main() {
+  const int kClients = 8;
+  const int kKeys = 500;
+  std::atomic<int> errors(0);
+  std::vector<std::thread> clients;
+  for (int i = 0; i < kClients; ++i) {
+    clients.emplace_back([&errors, kKeys]() {
+      weasel::Client client;
+      if (!client.Connect()) {
+        ++errors;
+        return;
+      }
+      client.StartSession();
+      for (int k = 0; k < kKeys; ++k) {
+        UINT keycode = L'a' + k % 26;
+        if (!client.ProcessKeyEvent(weasel::KeyEvent(keycode, 0))) {
+          ++errors;
+          continue;
+        }
+        WCHAR response[WEASEL_IPC_BUFFER_LENGTH];
+        client.GetResponseData(
+            std::bind<bool>(read_buffer, std::placeholders::_1,
+                            std::placeholders::_2, std::ref(response)));
+        std::wstring expected = L"Key=" + std::to_wstring(keycode) + L"\n";
+        if (!wcsstr(response, expected.c_str()))
+          ++errors;
+      }
+      client.EndSession();
+    });
+  }
+  for (auto& th : clients)
+    th.join();
+  std::cout << "stress test errors: " << errors << std::endl;
+  return errors ? -5 : 0;
+}
+
 class TestRequestHandler : public weasel::RequestHandler {
  public:
   TestRequestHandler() : m_counter(0) {
@@ -155,6 +198,8 @@ class TestRequestHandler : public weasel::RequestHandler {
               << " keycode: " << keyEvent.keycode << " mask: " << keyEvent.mask
               << std::endl;
     eat(std::wstring(L"Greeting=Hello, 小狼毫.\n"));
+    std::wstring key = L"Key=" + std::to_wstring(keyEvent.keycode) + L"\n";
+    eat(key);
     return TRUE;
   }
 
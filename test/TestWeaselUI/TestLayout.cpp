@@ -0,0 +1,195 @@
+﻿#include "stdafx.h"
+#include <boost/detail/lightweight_test.hpp>
+#include <HorizontalLayout.h>
+#include <VHorizontalLayout.h>
+#include <VerticalLayout.h>
+#include <memory>
+
+using namespace weasel;
+
+// em sizes of the label, text, comment and preedit fonts
+static const int kLabelEm = 12, kTextEm = 16, kCommentEm = 12, kPreeditEm = 14;
+
+struct LayoutCase {
+  std::string name;
+  UIStyle style;
+  Context ctx;
+  Status status;
+  // the n-th candidate is n emoji
+  bool emoji;
+};
+
+static UIStyle _MakeStyle(UIStyle::LayoutType type) {
+  UIStyle style;
+  style.layout_type = type;
+  // with fake metrics only the sign of the font points matters
+  style.font_point = kTextEm;
+  style.label_font_point = kLabelEm;
+  style.comment_font_point = kCommentEm;
+  style.border = 2;
+  style.margin_x = 10;
+  style.margin_y = 8;
+  style.spacing = 8;
+  style.candidate_spacing = 6;
+  style.hilite_spacing = 4;
+  style.hilite_padding_x = 4;
+  style.hilite_padding_y = 2;
+  style.round_corner = 4;
+  style.round_corner_ex = 6;
+  style.comment_text_color = 0xff808080;
+  style.hilited_comment_text_color = 0xff808080;
+  return style;
+}
+
+static LayoutCase _MakeCase(const char* name,
+                            const UIStyle& style,
+                            const std::vector<std::wstring>& texts) {
+  LayoutCase c;
+  c.name = name;
+  c.style = style;
+  c.ctx.preedit.str = L"ni hao";
+  for (size_t i = 0; i < texts.size(); ++i) {
+    c.ctx.cinfo.candies.push_back(Text(texts[i]));
+    c.ctx.cinfo.comments.push_back(Text(i % 2 ? L"~comment" : L""));
+    c.ctx.cinfo.labels.push_back(Text(std::to_wstring((i + 1) % 10)));
+  }
+  c.ctx.cinfo.highlighted = texts.size() > 1 ? 1 : 0;
+  c.status.composing = true;
+  c.emoji = false;
+  return c;
+}
+
+static std::vector<LayoutCase> _LayoutCases() {
+  const UIStyle::LayoutType types[] = {UIStyle::LAYOUT_HORIZONTAL,
+                                       UIStyle::LAYOUT_VERTICAL,
+                                       UIStyle::LAYOUT_VERTICAL_TEXT};
+  const char* names[] = {"horizontal", "vertical", "vertical text"};
+  std::vector<std::wstring> long_texts, emoji_texts, short_texts;
+  for (int i = 0; i < 5; ++i) {
+    long_texts.push_back(std::wstring(40, L'中'));
+    long_texts.push_back(L"pneumonoultramicroscopicsilicovolcanoconiosis");
+  }
+  std::wstring emoji;
+  for (int i = 0; i < 6; ++i)
+    emoji_texts.push_back(emoji += L"\U0001F600");
+  for (int i = 0; i < 20; ++i)
+    short_texts.push_back(std::wstring(4 + i % 3, L'字'));
+
+  std::vector<LayoutCase> cases;
+  for (int t = 0; t < _countof(types); ++t) {
+    UIStyle style = _MakeStyle(types[t]);
+    cases.push_back(_MakeCase((std::string(names[t]) + ", long").c_str(),
+                              style, long_texts));
+    cases.push_back(_MakeCase((std::string(names[t]) + ", emoji").c_str(),
+                              style, emoji_texts));
+    cases.back().emoji = true;
+  }
+  UIStyle style = _MakeStyle(UIStyle::LAYOUT_HORIZONTAL);
+  style.max_width = 360;
+  cases.push_back(_MakeCase("horizontal, wrap", style, short_texts));
+  style.balanced_wrap = true;
+  cases.push_back(_MakeCase("horizontal, balanced wrap", style, short_texts));
+  style = _MakeStyle(UIStyle::LAYOUT_VERTICAL_TEXT);
+  style.vertical_text_with_wrap = true;
+  style.max_height = 360;
+  cases.push_back(_MakeCase("vertical text, wrap", style, short_texts));
+  style.balanced_wrap = true;
+  cases.push_back(_MakeCase("vertical text, balanced wrap", style,
+                            short_texts));
+  return cases;
+}
+
+static Layout* _CreateLayout(const LayoutCase& c) {
+  if (c.style.layout_type == UIStyle::LAYOUT_VERTICAL_TEXT)
+    return new VHorizontalLayout(c.style, c.ctx, c.status, NULL);
+  if (c.style.layout_type == UIStyle::LAYOUT_HORIZONTAL)
+    return new HorizontalLayout(c.style, c.ctx, c.status, NULL);
+  return new VerticalLayout(c.style, c.ctx, c.status, NULL);
+}
+
+static bool _Inside(const CRect& rc, const CSize& size) {
+  return rc.left >= 0 && rc.top >= 0 && rc.right <= size.cx &&
+         rc.bottom <= size.cy;
+}
+
+static void _CheckLayout(const LayoutCase& c, Layout& layout) {
+  const CSize size = layout.GetContentSize();
+  const int count = (int)c.ctx.cinfo.candies.size();
+  const bool vertical_text =
+      c.style.layout_type == UIStyle::LAYOUT_VERTICAL_TEXT;
+  const bool wrap = c.style.max_width > 0 || c.style.max_height > 0;
+  BOOST_TEST(_Inside(layout.GetPreeditRect(), size));
+  BOOST_TEST(layout.GetHighlightRect() ==
+             layout.GetCandidateRect(c.ctx.cinfo.highlighted));
+  int lines = 1;
+  for (int i = 0; i < count; ++i) {
+    CRect rc = layout.GetCandidateRect(i);
+    CRect text = layout.GetCandidateTextRect(i);
+    CRect comment = layout.GetCandidateCommentRect(i);
+    BOOST_TEST(_Inside(rc, size));
+    BOOST_TEST(_Inside(text, size));
+    BOOST_TEST(_Inside(comment, size));
+    for (int j = 0; j < i; ++j) {
+      CRect overlap;
+      BOOST_TEST(!overlap.IntersectRect(rc, layout.GetCandidateRect(j)));
+    }
+    // a surrogate pair is one glyph
+    if (c.emoji)
+      BOOST_TEST((vertical_text ? text.Height() : text.Width()) ==
+                 (i + 1) * kTextEm);
+    if (!wrap)
+      continue;
+    if (i > 0 && (vertical_text
+                      ? rc.left != layout.GetCandidateRect(i - 1).left
+                      : rc.top != layout.GetCandidateRect(i - 1).top))
+      ++lines;
+    if (vertical_text)
+      BOOST_TEST(comment.bottom <= layout.offsetY + c.style.max_height -
+                                       layout.real_margin_y);
+    else
+      BOOST_TEST(comment.right <=
+                 layout.offsetX + c.style.max_width - layout.real_margin_x);
+  }
+  if (wrap)
+    BOOST_TEST(lines > 1);
+}
+
+// the layouts with deterministic metrics, in the long candidate, emoji,
+// vertical text and wrap cases
+void test_layout_geometry() {
+  CDC dc;
+  dc.CreateCompatibleDC(NULL);
+  std::vector<LayoutCase> cases = _LayoutCases();
+  for (const LayoutCase& c : cases) {
+    FakeTextMeasurer measurer(
+        kLabelEm, kTextEm, kCommentEm, kPreeditEm,
+        c.style.layout_type == UIStyle::LAYOUT_VERTICAL_TEXT);
+    std::unique_ptr<Layout> layout(_CreateLayout(c));
+    layout->SetTextMeasurer(&measurer);
+    layout->DoLayout(dc.m_hDC);
+    _CheckLayout(c, *layout);
+  }
+}
+
+void bench_layout() {
+  CDC dc;
+  dc.CreateCompatibleDC(NULL);
+  LARGE_INTEGER freq;
+  QueryPerformanceFrequency(&freq);
+  std::vector<LayoutCase> cases = _LayoutCases();
+  for (const LayoutCase& c : cases) {
+    FakeTextMeasurer measurer(
+        kLabelEm, kTextEm, kCommentEm, kPreeditEm,
+        c.style.layout_type == UIStyle::LAYOUT_VERTICAL_TEXT);
+    std::unique_ptr<Layout> layout(_CreateLayout(c));
+    layout->SetTextMeasurer(&measurer);
+    const int rounds = 2000;
+    LARGE_INTEGER t0, t1;
+    QueryPerformanceCounter(&t0);
+    for (int i = 0; i < rounds; ++i)
+      layout->DoLayout(dc.m_hDC);
+    QueryPerformanceCounter(&t1);
+    printf("layout %-28s %10.0f layouts/sec\n", c.name.c_str(),
+           rounds * (double)freq.QuadPart / (t1.QuadPart - t0.QuadPart));
+  }
+}
@@ -0,0 +1,156 @@
+﻿#include "stdafx.h"
+#include <boost/detail/lightweight_test.hpp>
+#include <WeaselUI.h>
+#include <fstream>
+
+using namespace weasel;
+
+// in the order of UIStyle::LayoutType
+static const char* kLayoutNames[] = {"vertical", "horizontal", "vertical_text",
+                                     "vertical_fullscreen",
+                                     "horizontal_fullscreen"};
+
+static UIStyle _MakeStyle(UIStyle::LayoutType type) {
+  UIStyle style;
+  style.layout_type = type;
+  style.font_face = style.label_font_face = style.comment_font_face =
+      L"Segoe UI";
+  style.font_point = 14;
+  style.label_font_point = 12;
+  style.comment_font_point = 12;
+  style.border = 1;
+  style.margin_x = 10;
+  style.margin_y = 8;
+  style.spacing = 8;
+  style.candidate_spacing = 6;
+  style.hilite_spacing = 4;
+  style.hilite_padding_x = 4;
+  style.hilite_padding_y = 2;
+  style.round_corner = 4;
+  style.round_corner_ex = 6;
+  // a shadow puts the blur in every frame
+  style.shadow_radius = 6;
+  style.shadow_offset_x = 2;
+  style.shadow_offset_y = 2;
+  style.shadow_color = 0x40000000;
+  style.back_color = 0xffffffff;
+  style.border_color = 0xff808080;
+  style.text_color = 0xff000000;
+  style.candidate_text_color = 0xff000000;
+  style.label_text_color = 0xff606060;
+  style.comment_text_color = 0xff808080;
+  style.hilited_text_color = 0xff000000;
+  style.hilited_back_color = 0xffe0e0e0;
+  style.hilited_candidate_text_color = 0xffffffff;
+  style.hilited_candidate_back_color = 0xffcc7a33;
+  style.hilited_label_text_color = 0xffffffff;
+  style.hilited_comment_text_color = 0xffeeeeee;
+  return style;
+}
+
+static Context _MakeContext() {
+  const wchar_t* texts[] = {L"輸入法", L"書法", L"樹", L"weasel",
+                            L"\U0001F600"};
+  Context ctx;
+  ctx.preedit.str = L"shu ru fa";
+  for (int i = 0; i < _countof(texts); ++i) {
+    ctx.cinfo.candies.push_back(Text(texts[i]));
+    ctx.cinfo.comments.push_back(Text(i % 2 ? L"~shu" : L""));
+    ctx.cinfo.labels.push_back(Text(std::to_wstring(i + 1)));
+  }
+  ctx.cinfo.totalPages = 1;
+  return ctx;
+}
+
+static Status _MakeStatus() {
+  Status status;
+  status.composing = true;
+  return status;
+}
+
+// the same input renders the same pixels, another highlight other ones
+void test_render_offscreen() {
+  const Context ctx = _MakeContext();
+  const Status status = _MakeStatus();
+  for (int t = 0; t < UIStyle::LAYOUT_TYPE_LAST; ++t) {
+    UI ui;
+    ui.style() = _MakeStyle((UIStyle::LayoutType)t);
+    std::vector<BYTE> first, second, moved;
+    SIZE size1 = {0}, size2 = {0}, size3 = {0};
+    BOOST_TEST(ui.RenderOffscreen(ctx, status, first, size1));
+    BOOST_TEST(size1.cx > 0 && size1.cy > 0);
+    BOOST_TEST(ui.RenderOffscreen(ctx, status, second, size2));
+    BOOST_TEST(size1.cx == size2.cx && size1.cy == size2.cy);
+    BOOST_TEST(first == second);
+
+    Context next(ctx);
+    next.cinfo.highlighted = 2;
+    BOOST_TEST(ui.RenderOffscreen(next, status, moved, size3));
+    BOOST_TEST(first != moved);
+  }
+}
+
+// compares each layout type with <dir>\render_<type>.bgra, a width and a
+// height as int followed by the pixels; a missing image is recorded, so
+// the first run on a machine sets its golden images
+void test_render_golden(const std::wstring& dir) {
+  const Context ctx = _MakeContext();
+  const Status status = _MakeStatus();
+  for (int t = 0; t < UIStyle::LAYOUT_TYPE_LAST; ++t) {
+    UI ui;
+    ui.style() = _MakeStyle((UIStyle::LayoutType)t);
+    std::vector<BYTE> pixels;
+    SIZE size = {0};
+    if (!ui.RenderOffscreen(ctx, status, pixels, size)) {
+      BOOST_ERROR("RenderOffscreen failed");
+      continue;
+    }
+    std::string name = std::string("render_") + kLayoutNames[t] + ".bgra";
+    std::wstring path = dir + L"\\" + std::wstring(name.begin(), name.end());
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+      std::ofstream out(path, std::ios::binary);
+      out.write((const char*)&size.cx, sizeof(int));
+      out.write((const char*)&size.cy, sizeof(int));
+      out.write((const char*)pixels.data(), pixels.size());
+      BOOST_TEST(out.good());
+      printf("recorded %s (%dx%d)\n", name.c_str(), size.cx, size.cy);
+      continue;
+    }
+    int cx = 0, cy = 0;
+    in.read((char*)&cx, sizeof(int));
+    in.read((char*)&cy, sizeof(int));
+    std::vector<BYTE> golden((size_t)max(cx, 0) * max(cy, 0) * 4);
+    in.read((char*)golden.data(), golden.size());
+    if (!in || cx != size.cx || cy != size.cy || golden != pixels) {
+      printf("%s differs from the golden image\n", name.c_str());
+      BOOST_ERROR("rendering changed");
+    }
+  }
+}
+
+// frames/sec of the whole pipeline per layout type, each frame moving the
+// highlight like paging through the candidates does
+void bench_render() {
+  LARGE_INTEGER freq;
+  QueryPerformanceFrequency(&freq);
+  const Status status = _MakeStatus();
+  for (int t = 0; t < UIStyle::LAYOUT_TYPE_LAST; ++t) {
+    UI ui;
+    ui.style() = _MakeStyle((UIStyle::LayoutType)t);
+    Context ctx = _MakeContext();
+    std::vector<BYTE> pixels;
+    SIZE size = {0};
+    const int frames = 200;
+    LARGE_INTEGER t0, t1;
+    QueryPerformanceCounter(&t0);
+    for (int i = 0; i < frames; ++i) {
+      ctx.cinfo.highlighted = i % ctx.cinfo.candies.size();
+      ui.RenderOffscreen(ctx, status, pixels, size);
+    }
+    QueryPerformanceCounter(&t1);
+    printf("render %-22s %4dx%-4d %8.1f frames/sec\n", kLayoutNames[t],
+           size.cx, size.cy,
+           frames * (double)freq.QuadPart / (t1.QuadPart - t0.QuadPart));
+  }
+}
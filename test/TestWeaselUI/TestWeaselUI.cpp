@@ -0,0 +1,36 @@
+﻿// TestWeaselUI.cpp : Defines the entry point for the console application.
+//
+
+#include "stdafx.h"
+#include <boost/detail/lightweight_test.hpp>
+#include <gdiplus.h>
+#include <string>
+
+void test_blur_matches_reference();
+void bench_blur();
+void test_layout_geometry();
+void bench_layout();
+void test_render_offscreen();
+void test_render_golden(const std::wstring& dir);
+void bench_render();
+
+// TestWeaselUI [golden image dir]
+int _tmain(int argc, _TCHAR* argv[]) {
+  // the layouts test round corners with GDI+ regions
+  Gdiplus::GdiplusStartupInput input;
+  ULONG_PTR token;
+  Gdiplus::GdiplusStartup(&token, &input, NULL);
+
+  test_blur_matches_reference();
+  bench_blur();
+  test_layout_geometry();
+  bench_layout();
+  test_render_offscreen();
+  if (argc > 1)
+    test_render_golden(argv[1]);
+  bench_render();
+
+  Gdiplus::GdiplusShutdown(token);
+  system("pause");
+  return boost::report_errors();
+}
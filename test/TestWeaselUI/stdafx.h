@@ -0,0 +1,23 @@
+// stdafx.h : include file for standard system include files,
+// or project specific include files that are used frequently, but
+// are changed infrequently
+//
+
+#pragma once
+
+#include "targetver.h"
+
+#include <stdio.h>
+#include <tchar.h>
+
+#include <atlbase.h>
+#include <atlwin.h>
+
+#include <wtl/atlapp.h>
+#include <wtl/atlgdi.h>
+#include <wtl/atlmisc.h>
+
+#include <string>
+#include <vector>
+
+#define GDIPVER 0x0110